@@ -6,8 +6,6 @@
 #include "coords.h"
 #include "mcts.h"
 
-void Coords_calc_move(struct Coords* coords, enum Direction direction);
-void Coords_map_move(struct Coords* coords, enum Direction direction);
 
 int main()
 {
@@ -15,31 +13,38 @@ int main()
     srand(seed);
 
     init_coords();
+    init_state();
 
     enum Direction d[100];
     for (int i = 0; i < 100; i++) {
         d[i] = rand() % NUM_DIRECTIONS;
     }
+
+    // Each walk is checked once it's done, so the compiler can't optimize
+    // away the moves
     {
         struct Coords coords;
         coords.q = 0;
         coords.r = 0;
-        BENCHMARK_START("Coords_map_move", 1000000)
+        BENCHMARK_START("Coords_move", 1000000)
         for (int i = 0; i < 100; i++) {
-            Coords_map_move(&coords, d[i]);
+            Coords_move(&coords, d[i]);
         }
         BENCHMARK_END
+        if (coords.q >= GRID_SIZE) {
+            return 1;
+        }
     }
     {
-        struct Coords coords;
-        coords.q = 0;
-        coords.r = 0;
-        enum Direction d[100];
-        BENCHMARK_START("Coords_calc_move", 1000000)
+        uint16_t cell = 0;
+        BENCHMARK_START("Cell_move", 1000000)
         for (int i = 0; i < 100; i++) {
-            Coords_calc_move(&coords, d[i]);
+            cell = Cell_move(cell, d[i]);
         }
         BENCHMARK_END
+        if (cell >= NUM_CELLS) {
+            return 1;
+        }
     }
 
     {
@@ -0,0 +1,136 @@
+#include "bitboard.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "coords.h"
+
+// Moves every hex in a column one step north (r - 1), wrapping around
+uint32_t Bitboard_column_north(uint32_t column)
+{
+    return (column >> 1 | column << (GRID_SIZE - 1)) & BITBOARD_COLUMN;
+}
+
+// Moves every hex in a column one step south (r + 1), wrapping around
+uint32_t Bitboard_column_south(uint32_t column)
+{
+    return (column << 1 | column >> (GRID_SIZE - 1)) & BITBOARD_COLUMN;
+}
+
+// Copies a bitboard's columns so that columns q - 1, q and q + 1 (wrapping
+// around) are padded[q], padded[q + 1] and padded[q + 2]
+void Bitboard_pad(const struct Bitboard* bitboard, uint32_t padded[GRID_SIZE + 2])
+{
+    padded[0] = bitboard->columns[GRID_SIZE - 1];
+    memcpy(&padded[1], bitboard->columns, sizeof(uint32_t) * GRID_SIZE);
+    padded[GRID_SIZE + 1] = bitboard->columns[0];
+}
+
+void Bitboard_clear(struct Bitboard* bitboard)
+{
+    memset(bitboard, 0, sizeof(struct Bitboard));
+}
+
+bool Bitboard_empty(const struct Bitboard* bitboard)
+{
+    uint32_t columns = 0;
+    for (int q = 0; q < GRID_SIZE; q++) {
+        columns |= bitboard->columns[q];
+    }
+    return !columns;
+}
+
+void Bitboard_and(struct Bitboard* dest, const struct Bitboard* a, const struct Bitboard* b)
+{
+    for (int q = 0; q < GRID_SIZE; q++) {
+        dest->columns[q] = a->columns[q] & b->columns[q];
+    }
+}
+
+void Bitboard_and_not(struct Bitboard* dest, const struct Bitboard* a, const struct Bitboard* b)
+{
+    for (int q = 0; q < GRID_SIZE; q++) {
+        dest->columns[q] = a->columns[q] & ~b->columns[q];
+    }
+}
+
+void Bitboard_or(struct Bitboard* dest, const struct Bitboard* a, const struct Bitboard* b)
+{
+    for (int q = 0; q < GRID_SIZE; q++) {
+        dest->columns[q] = a->columns[q] | b->columns[q];
+    }
+}
+
+void Bitboard_shift(struct Bitboard* dest, const struct Bitboard* source, enum Direction direction)
+{
+    uint32_t padded[GRID_SIZE + 2];
+    Bitboard_pad(source, padded);
+
+    // Column q of dest comes from column q - 1 of source when moving east,
+    // and q + 1 when moving west
+    const uint32_t* columns = &padded[1];
+    if (direction == NORTHEAST || direction == SOUTHEAST) {
+        columns = &padded[0];
+    } else if (direction == SOUTHWEST || direction == NORTHWEST) {
+        columns = &padded[2];
+    }
+
+    switch (direction) {
+    case NORTH:
+    case NORTHEAST:
+        for (int q = 0; q < GRID_SIZE; q++) {
+            dest->columns[q] = Bitboard_column_north(columns[q]);
+        }
+        break;
+
+    case SOUTH:
+    case SOUTHWEST:
+        for (int q = 0; q < GRID_SIZE; q++) {
+            dest->columns[q] = Bitboard_column_south(columns[q]);
+        }
+        break;
+
+    case SOUTHEAST:
+    case NORTHWEST:
+        memcpy(dest->columns, columns, sizeof(uint32_t) * GRID_SIZE);
+        break;
+    }
+}
+
+/* Shifts source in all six directions at once, and adds the shifted
+ * bitboards up a bit at a time: a hex is in once if it's in exactly one
+ * of them, and in any if it's in at least one.
+ */
+void Bitboard_neighbors(const struct Bitboard* source, struct Bitboard* once, struct Bitboard* any)
+{
+    uint32_t padded[GRID_SIZE + 2];
+    Bitboard_pad(source, padded);
+
+    for (int q = 0; q < GRID_SIZE; q++) {
+        uint32_t west = padded[q];
+        uint32_t here = padded[q + 1];
+        uint32_t east = padded[q + 2];
+
+        // Neighbors to the north, northeast, southeast, south, southwest
+        // and northwest, as in Bitboard_shift
+        uint32_t shifted[NUM_DIRECTIONS] = {
+            Bitboard_column_north(here),
+            Bitboard_column_north(west),
+            west,
+            Bitboard_column_south(here),
+            Bitboard_column_south(east),
+            east,
+        };
+
+        uint32_t one = 0;
+        uint32_t more = 0;
+        for (int d = 0; d < NUM_DIRECTIONS; d++) {
+            more |= one & shifted[d];
+            one |= shifted[d];
+        }
+
+        once->columns[q] = one & ~more;
+        any->columns[q] = one;
+    }
+}
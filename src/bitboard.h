@@ -0,0 +1,75 @@
+/* Sets of hexes, one bit per hex, with a 32-bit column per q holding a
+ * bit per r. Operations work a column at a time in plain loops with no
+ * dependencies between columns, so the compiler can vectorize them (with
+ * SSE2 on any x86-64 build, or AVX2 where it's enabled). Building
+ * bitboard.c with -fopt-info-vec lists the loops that were vectorized;
+ * every loop here should be, including Bitboard_shift's and
+ * Bitboard_neighbors'.
+ */
+
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "coords.h"
+
+#define BITBOARD_COLUMN ((UINT32_C(1) << GRID_SIZE) - 1)
+
+struct Bitboard {
+    uint32_t columns[GRID_SIZE];
+};
+
+static inline bool Bitboard_test(const struct Bitboard* bitboard, const struct Coords* coords)
+{
+    return bitboard->columns[coords->q] >> coords->r & 1;
+}
+
+static inline void Bitboard_set(struct Bitboard* bitboard, const struct Coords* coords)
+{
+    bitboard->columns[coords->q] |= UINT32_C(1) << coords->r;
+}
+
+static inline void Bitboard_reset(struct Bitboard* bitboard, const struct Coords* coords)
+{
+    bitboard->columns[coords->q] &= ~(UINT32_C(1) << coords->r);
+}
+
+// A set of cells, for where indexing by cell is more convenient than by
+// coords (e.g. a walk's visited hexes)
+struct CellSet {
+    uint64_t words[(NUM_CELLS + 63) / 64];
+};
+
+static inline bool CellSet_test(const struct CellSet* set, uint16_t cell)
+{
+    return set->words[cell / 64] >> (cell % 64) & 1;
+}
+
+static inline void CellSet_set(struct CellSet* set, uint16_t cell)
+{
+    set->words[cell / 64] |= UINT64_C(1) << (cell % 64);
+}
+
+static inline void CellSet_clear(struct CellSet* set)
+{
+    for (int i = 0; i < (NUM_CELLS + 63) / 64; i++) {
+        set->words[i] = 0;
+    }
+}
+
+void Bitboard_clear(struct Bitboard* bitboard);
+bool Bitboard_empty(const struct Bitboard* bitboard);
+
+void Bitboard_and(struct Bitboard* dest, const struct Bitboard* a, const struct Bitboard* b);
+void Bitboard_and_not(struct Bitboard* dest, const struct Bitboard* a, const struct Bitboard* b);
+void Bitboard_or(struct Bitboard* dest, const struct Bitboard* a, const struct Bitboard* b);
+
+// Moves every hex in a bitboard one step in a direction
+void Bitboard_shift(struct Bitboard* dest, const struct Bitboard* source, enum Direction direction);
+
+// Finds hexes next to exactly one hex in source, and hexes next to any
+void Bitboard_neighbors(const struct Bitboard* source, struct Bitboard* once, struct Bitboard* any);
+
+#endif
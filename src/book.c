@@ -1,9 +1,10 @@
 #include <stdlib.h>
 
 #include "book.h"
+#include "rng.h"
 #include "state.h"
 
-const struct Action* opening_move(const struct State* state)
+const struct Action* opening_move(const struct State* state, struct Rng* rng)
 {
     const struct Action* actions[MAX_ACTIONS];
     int action_count = 0;
@@ -36,7 +37,7 @@ const struct Action* opening_move(const struct State* state)
     */
 
     if (action_count) {
-        return actions[rand() % action_count];
+        return actions[Rng_below(rng, action_count)];
     }
 
     return NULL;
@@ -1,8 +1,9 @@
 #ifndef OPENING_H
 #define OPENING_H
 
+#include "rng.h"
 #include "state.h"
 
-const struct Action* opening_move(const struct State* state);
+const struct Action* opening_move(const struct State* state, struct Rng* rng);
 
 #endif
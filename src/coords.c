@@ -3,78 +3,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "state.h"
-
 const enum Direction OPPOSITE[NUM_DIRECTIONS] = { SOUTH, SOUTHWEST, NORTHWEST,
     NORTH, NORTHEAST, SOUTHEAST };
 
-struct Coords coords_neighbors_map[GRID_SIZE][GRID_SIZE][NUM_DIRECTIONS];
-bool coords_adjacent_map[GRID_SIZE][GRID_SIZE][GRID_SIZE][GRID_SIZE];
-
-void Coords_calc_move(struct Coords* coords, enum Direction direction)
-{
-    switch (direction) {
-    case NORTH:
-        if (coords->r == 0)
-            coords->r = GRID_SIZE - 1;
-        else
-            coords->r--;
-        break;
-
-    case NORTHEAST:
-        if (coords->q == GRID_SIZE - 1)
-            coords->q = 0;
-        else
-            coords->q++;
-        if (coords->r == 0)
-            coords->r = GRID_SIZE - 1;
-        else
-            coords->r--;
-        break;
-
-    case SOUTHEAST:
-        if (coords->q == GRID_SIZE - 1)
-            coords->q = 0;
-        else
-            coords->q++;
-        break;
-
-    case SOUTH:
-        if (coords->r == GRID_SIZE - 1)
-            coords->r = 0;
-        else
-            coords->r++;
-        break;
-
-    case SOUTHWEST:
-        if (coords->q == 0)
-            coords->q = GRID_SIZE - 1;
-        else
-            coords->q--;
-        if (coords->r == GRID_SIZE - 1)
-            coords->r = 0;
-        else
-            coords->r++;
-        break;
-
-    case NORTHWEST:
-        if (coords->q == 0)
-            coords->q = GRID_SIZE - 1;
-        else
-            coords->q--;
-        break;
-    }
-}
-
-void Coords_map_move(struct Coords* coords, enum Direction direction)
-{
-    *coords = coords_neighbors_map[coords->q][coords->r][direction];
-}
-
-void Coords_move(struct Coords* coords, enum Direction direction)
-{
-    Coords_calc_move(coords, direction);
-}
+uint16_t cell_neighbors_map[NUM_CELLS][NUM_DIRECTIONS];
+struct Slides slides_map[1 << NUM_DIRECTIONS];
 
 // https://www.redblobgames.com/grids/hexagons/#distances-axial
 unsigned int Coords_distance(const struct Coords* coords, const struct Coords* other)
@@ -85,51 +18,32 @@ unsigned int Coords_distance(const struct Coords* coords, const struct Coords* o
         / 2;
 }
 
-bool Coords_calc_adjacent(const struct Coords* coords, const struct Coords* other)
-{
-    for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
-        struct Coords c = *coords;
-        Coords_move(&c, d);
-        if (c.q == other->q && c.r == other->r) {
-            return true;
-        }
-    }
-
-    return false;
-}
-
-bool Coords_map_adjacent(const struct Coords* coords, const struct Coords* other)
-{
-    if (coords->q == PLACE_ACTION || other->q == PLACE_ACTION) {
-        return false;
-    }
-    return coords_adjacent_map[coords->q][coords->r][other->q][other->r];
-}
-
-bool Coords_adjacent(const struct Coords* coords, const struct Coords* other)
-{
-    return Coords_map_adjacent(coords, other);
-}
-
 void init_coords()
 {
     for (int q = 0; q < GRID_SIZE; q++) {
         for (int r = 0; r < GRID_SIZE; r++) {
             for (int d = 0; d < NUM_DIRECTIONS; d++) {
-                coords_neighbors_map[q][r][d].q = q;
-                coords_neighbors_map[q][r][d].r = r;
-                Coords_calc_move(&coords_neighbors_map[q][r][d], d);
+                struct Coords coords = { q, r };
+                Coords_move(&coords, d);
+                cell_neighbors_map[q * GRID_SIZE + r][d] = Coords_cell(&coords);
+            }
+        }
+    }
+
+    for (int mask = 0; mask < 1 << NUM_DIRECTIONS; mask++) {
+        struct Slides* slides = &slides_map[mask];
+        slides->count = 0;
+
+        for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+            if (!(mask & 1 << d)) {
+                continue;
             }
 
-            for (int oq = 0; oq < GRID_SIZE; oq++) {
-                for (int or = 0; or < GRID_SIZE; or ++) {
-                    struct Coords coords;
-                    coords.q = q;
-                    coords.r = r;
-                    struct Coords other;
-                    other.q = oq;
-                    other.r = or ;
-                    coords_adjacent_map[q][r][oq][or] = Coords_calc_adjacent(&coords, &other);
+            for (int turn = 1; turn >= -1; turn -= 2) {
+                enum Direction to = Direction_rotate(d, turn);
+                enum Direction beside = Direction_rotate(d, 2 * turn);
+                if (!(mask & 1 << to) && !(mask & 1 << beside)) {
+                    slides->directions[slides->count++] = to;
                 }
             }
         }
@@ -5,6 +5,9 @@
 #include <stdint.h>
 #include <stdio.h>
 
+// The grid wraps around at the edges
+#define GRID_SIZE 24
+
 #define NUM_DIRECTIONS 6
 enum Direction {
     NORTH = 0,
@@ -15,6 +18,10 @@ enum Direction {
     NORTHWEST
 };
 
+// A hex can also be referred to by a single cell index, q * GRID_SIZE + r,
+// which is where it falls in a [GRID_SIZE][GRID_SIZE] array
+#define NUM_CELLS (GRID_SIZE * GRID_SIZE)
+
 extern const enum Direction OPPOSITE[NUM_DIRECTIONS];
 
 struct Coords {
@@ -22,14 +29,124 @@ struct Coords {
     uint8_t r;
 };
 
+// Neighbors of each cell, filled in by init_coords
+extern uint16_t cell_neighbors_map[NUM_CELLS][NUM_DIRECTIONS];
+
+/* The directions a piece can slide in along the hive, for each mask of
+ * occupied neighbors (with bit d set if the neighbor in direction d is
+ * occupied), filled in by init_coords. A piece can slide into an empty
+ * neighbor if exactly one of the two hexes beside it is occupied: the
+ * piece has to stay in contact with the hive, but can't squeeze through a
+ * gap. Directions are listed going around the occupied neighbors, trying
+ * the slide clockwise of each before the one counterclockwise of it.
+ */
+struct Slides {
+    uint8_t count;
+    uint8_t directions[NUM_DIRECTIONS];
+};
+extern struct Slides slides_map[1 << NUM_DIRECTIONS];
+
 void init_coords();
 
-void Coords_move(struct Coords* coords, enum Direction direction);
-void Coords_move_old(struct Coords* coords, enum Direction direction);
+static inline void Coords_move(struct Coords* coords, enum Direction direction)
+{
+    switch (direction) {
+    case NORTH:
+        if (coords->r == 0)
+            coords->r = GRID_SIZE - 1;
+        else
+            coords->r--;
+        break;
+
+    case NORTHEAST:
+        if (coords->q == GRID_SIZE - 1)
+            coords->q = 0;
+        else
+            coords->q++;
+        if (coords->r == 0)
+            coords->r = GRID_SIZE - 1;
+        else
+            coords->r--;
+        break;
+
+    case SOUTHEAST:
+        if (coords->q == GRID_SIZE - 1)
+            coords->q = 0;
+        else
+            coords->q++;
+        break;
+
+    case SOUTH:
+        if (coords->r == GRID_SIZE - 1)
+            coords->r = 0;
+        else
+            coords->r++;
+        break;
+
+    case SOUTHWEST:
+        if (coords->q == 0)
+            coords->q = GRID_SIZE - 1;
+        else
+            coords->q--;
+        if (coords->r == GRID_SIZE - 1)
+            coords->r = 0;
+        else
+            coords->r++;
+        break;
+
+    case NORTHWEST:
+        if (coords->q == 0)
+            coords->q = GRID_SIZE - 1;
+        else
+            coords->q--;
+        break;
+    }
+}
+
+static inline uint16_t Coords_cell(const struct Coords* coords)
+{
+    return coords->q * GRID_SIZE + coords->r;
+}
+
+static inline struct Coords Cell_coords(uint16_t cell)
+{
+    struct Coords coords = { cell / GRID_SIZE, cell % GRID_SIZE };
+    return coords;
+}
+
+static inline uint16_t Cell_move(uint16_t cell, enum Direction direction)
+{
+    return cell_neighbors_map[cell][direction];
+}
 
 unsigned int Coords_distance(const struct Coords* coords, const struct Coords* other);
 
-bool Coords_adjacent(const struct Coords* coords, const struct Coords* other);
+/* Two hexes are adjacent if they're at most one step apart in q and in r
+ * (wrapping around), and if they're apart in both, in opposite
+ * directions. Coords off the grid (e.g. the from of a place action)
+ * aren't adjacent to anything.
+ */
+static inline bool Coords_adjacent(const struct Coords* coords, const struct Coords* other)
+{
+    if (coords->q >= GRID_SIZE || other->q >= GRID_SIZE) {
+        return false;
+    }
+
+    int dq = other->q - coords->q;
+    int dr = other->r - coords->r;
+    if (dq > 1) {
+        dq -= GRID_SIZE;
+    } else if (dq < -1) {
+        dq += GRID_SIZE;
+    }
+    if (dr > 1) {
+        dr -= GRID_SIZE;
+    } else if (dr < -1) {
+        dr += GRID_SIZE;
+    }
+
+    return dq >= -1 && dq <= 1 && dr >= -1 && dr <= 1 && dq != dr;
+}
 
 enum Direction
 Direction_rotate(enum Direction direction, int n);
@@ -0,0 +1,74 @@
+#include "evaluate.h"
+
+#include <math.h>
+
+#include "state.h"
+
+// How much a piece of each type adds to its player's mobility, if it's
+// free to move
+const int PIECE_MOBILITY[NUM_PIECETYPES] = {
+    [ANT] = 3,
+    [BEETLE] = 2,
+    [GRASSHOPPER] = 1,
+    [SPIDER] = 1,
+    [QUEEN_BEE] = 1,
+};
+
+/**
+ * scores a state for the player to move, between -1 and 1, from what the
+ * state keeps up to date as actions are taken (neighbor masks, tops and
+ * cut points), so it's a single pass over the pieces rather than a search
+ */
+float State_evaluate(const struct State* state)
+{
+    int surrounded[NUM_PLAYERS];
+    int mobility[NUM_PLAYERS];
+    int pinned[NUM_PLAYERS];
+    for (enum Player p = 0; p < NUM_PLAYERS; p++) {
+        surrounded[p] = 0;
+        mobility[p] = 0;
+        pinned[p] = 0;
+
+        if (state->queens[p]) {
+            const struct Piece* queen = State_piece(state, state->queens[p]);
+            surrounded[p] = __builtin_popcount(state->neighbor_masks[Coords_cell(&queen->coords)]);
+        }
+
+        for (int i = 0; i < state->piece_count[p]; i++) {
+            const struct Piece* piece = &state->pieces[p][i];
+            if (piece->on_top) {
+                continue;
+            }
+
+            // Pinned, in the sense of pin hexes: the only piece an enemy
+            // piece touches, so it can't move without leaving that one
+            // behind
+            uint16_t cell = Coords_cell(&piece->coords);
+            for (uint8_t mask = state->neighbor_masks[cell]; mask; mask &= mask - 1) {
+                uint16_t neighbor = Cell_move(cell, __builtin_ctz(mask));
+                struct Coords coords = Cell_coords(neighbor);
+                if (__builtin_popcount(state->neighbor_masks[neighbor]) == 1
+                    && Bitboard_test(&state->tops[!p], &coords)) {
+                    pinned[p]++;
+                    break;
+                }
+            }
+
+            // A player can't move until their queen is placed, and beetles
+            // on top of the hive ignore the one hive rule
+            if (state->queens[p]
+                && (!state->cut_points[piece->coords.q][piece->coords.r]
+                    || state->grid[piece->coords.q][piece->coords.r] != Piece_id(p, i))) {
+                mobility[p] += PIECE_MOBILITY[piece->type];
+            }
+        }
+    }
+
+    enum Player turn = state->turn;
+    float score = EVAL_QUEEN_WEIGHT * (surrounded[!turn] * surrounded[!turn] - surrounded[turn] * surrounded[turn])
+        + EVAL_MOBILITY_WEIGHT * (mobility[turn] - mobility[!turn])
+        + EVAL_PINNED_WEIGHT * (pinned[!turn] - pinned[turn])
+        + EVAL_CUT_POINT_WEIGHT * (state->cut_point_count[!turn] - state->cut_point_count[turn]);
+
+    return tanhf(score);
+}
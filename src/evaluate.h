@@ -0,0 +1,23 @@
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include "state.h"
+
+/* Weights of the evaluation's terms, each the player to move's less the
+ * enemy's (or the enemy's less theirs, for things that are bad to have):
+ * - how surrounded each queen is, squared, so the last few pieces around
+ *   a queen count for the most
+ * - pieces free to move, with ants counting for more and grasshoppers,
+ *   spiders and the queen for less
+ * - pieces pinned by an enemy piece, i.e. the only piece it touches, as
+ *   one moved to a pin hex would be
+ * - pieces on cut points, i.e. held in place by the one hive rule
+ */
+#define EVAL_QUEEN_WEIGHT 0.1
+#define EVAL_MOBILITY_WEIGHT 0.04
+#define EVAL_PINNED_WEIGHT 0.05
+#define EVAL_CUT_POINT_WEIGHT 0.05
+
+float State_evaluate(const struct State* state);
+
+#endif
@@ -1,28 +1,36 @@
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "mcts.h"
+#include "pool.h"
 #include "simulate.h"
 #include "state.h"
 
-// store these globally so we don't have to pass them around
-static struct MCTSOptions options;
-static struct MCTSResults* results;
+/**
+ * returns whether nodes below the root are expanded lazily
+ */
+bool MCTSOptions_lazy(const struct MCTSOptions* o)
+{
+    return o->puct || o->widening;
+}
 
 /**
- * mallocs, checks for null, and increases results.stats.tree_bytes
+ * mallocs, checks for null, and increases the arena's bytes
  */
-void* mctsmalloc(size_t size)
+void* mctsmalloc(struct NodeArena* arena, size_t size)
 {
     void* ptr = malloc(size);
     if (ptr == NULL) {
         fprintf(stderr, "ERROR: failure to malloc in MCTS\n");
         exit(1);
     }
-    results->stats.tree_bytes += size;
+    arena->bytes += size;
     return ptr;
 }
 
@@ -31,8 +39,22 @@ void MCTSOptions_default(struct MCTSOptions* o)
     o->iterations = DEFAULT_ITERATIONS;
     o->uctc = DEFAULT_UCTC;
     o->max_sim_depth = DEFAULT_MAX_SIM_DEPTH;
+    o->seed = DEFAULT_SEED;
     o->save_tree = DEFAULT_SAVE_TREE;
+    o->reuse_tree = DEFAULT_REUSE_TREE;
+    o->threads = DEFAULT_THREADS;
+    o->root_parallel = DEFAULT_ROOT_PARALLEL;
+    o->graph = DEFAULT_GRAPH;
+    o->solver = DEFAULT_SOLVER;
+    o->puct = DEFAULT_PUCT;
+    o->puctc = DEFAULT_PUCTC;
+    o->prior = State_policy_priors;
+    o->widening = DEFAULT_WIDENING;
+    o->widening_c = DEFAULT_WIDENING_C;
+    o->widening_exponent = DEFAULT_WIDENING_EXPONENT;
 
+    o->light_playouts = DEFAULT_LIGHT_PLAYOUTS;
+    o->eval_depth = DEFAULT_EVAL_DEPTH;
     o->queen_sidestep_bias = DEFAULT_QUEEN_SIDESTEP_BIAS;
     o->queen_away_move_bias = DEFAULT_QUEEN_AWAY_MOVE_BIAS;
     o->queen_pin_move_bias = DEFAULT_QUEEN_PIN_BIAS;
@@ -48,168 +70,1150 @@ void MCTSOptions_default(struct MCTSOptions* o)
     o->cut_point_diff_terminate_value = DEFAULT_CUT_POINT_DIFF_TERM_VALUE;
 }
 
-void Node_init(struct Node* node, uint8_t depth)
+void NodeArena_init(struct NodeArena* arena)
+{
+    arena->chunks = malloc(sizeof(struct Node*) * MAX_NODE_CHUNKS);
+    if (arena->chunks == NULL) {
+        fprintf(stderr, "ERROR: failure to malloc in MCTS\n");
+        exit(1);
+    }
+    arena->chunk_count = 0;
+    arena->size = 0;
+    arena->bytes = 0;
+    pthread_mutex_init(&arena->lock, NULL);
+}
+
+/**
+ * allocates count contiguous nodes, starting a new chunk if they don't
+ * fit in what's left of the current one, and returns the first's index
+ */
+uint32_t NodeArena_alloc(struct NodeArena* arena, uint32_t count)
+{
+    pthread_mutex_lock(&arena->lock);
+
+    uint32_t offset = arena->size & (NODE_CHUNK_SIZE - 1);
+    if (arena->size == (uint32_t)arena->chunk_count << NODE_CHUNK_BITS
+        || offset + count > NODE_CHUNK_SIZE) {
+        if (arena->chunk_count == MAX_NODE_CHUNKS) {
+            fprintf(stderr, "ERROR: MCTS tree is out of node indices\n");
+            exit(1);
+        }
+
+        arena->chunks[arena->chunk_count] = mctsmalloc(arena, sizeof(struct Node) * NODE_CHUNK_SIZE);
+        arena->size = arena->chunk_count++ << NODE_CHUNK_BITS;
+    }
+
+    uint32_t index = arena->size;
+    arena->size += count;
+
+    pthread_mutex_unlock(&arena->lock);
+    return index;
+}
+
+void NodeArena_free(struct NodeArena* arena)
+{
+    for (uint32_t i = 0; i < arena->chunk_count; i++) {
+        free(arena->chunks[i]);
+    }
+    free(arena->chunks);
+    arena->chunks = NULL;
+    arena->chunk_count = 0;
+    arena->size = 0;
+    pthread_mutex_destroy(&arena->lock);
+}
+
+/**
+ * hands the nodes of an arena over to another, uninitialized one, leaving
+ * the first freed
+ */
+void NodeArena_move(struct NodeArena* dest, struct NodeArena* source)
+{
+    dest->chunks = source->chunks;
+    dest->chunk_count = source->chunk_count;
+    dest->size = source->size;
+    dest->bytes = source->bytes;
+    pthread_mutex_init(&dest->lock, NULL);
+
+    source->chunks = NULL;
+    source->chunk_count = 0;
+    source->size = 0;
+    pthread_mutex_destroy(&source->lock);
+}
+
+void* checked_realloc(void* ptr, size_t size)
+{
+    ptr = realloc(ptr, size);
+    if (ptr == NULL) {
+        fprintf(stderr, "ERROR: failure to malloc in MCTS\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+/* Walks a node's children, whether they're a single block or, for a
+ * lazily expanded node, a chain of them
+ */
+struct Children {
+    const struct NodeArena* arena;
+    // Children left to walk, and the index of the next
+    uint16_t left;
+    uint32_t next;
+    // Index of the node after the current block, or NO_NODE if there's
+    // just the one block
+    uint32_t block_end;
+    uint32_t block_size;
+    // Whether the node is expanded lazily, or not at all, so that more
+    // children can be opened
+    bool lazy;
+};
+
+void Children_start(struct Children* children, const struct NodeArena* arena, const struct Node* node)
+{
+    // The count is published after the children it counts
+    uint16_t count = __atomic_load_n(&node->children_count, __ATOMIC_ACQUIRE);
+    uint32_t first = __atomic_load_n(&node->children, __ATOMIC_ACQUIRE);
+
+    children->arena = arena;
+    children->next = first;
+    // A PUCT search only expands its root in full, before its threads
+    // start, so any other node without a count can have children opened
+    children->lazy = !count || (count & LAZY);
+    children->left = count & ~LAZY;
+    children->block_size = LAZY_BLOCK_SIZE;
+    children->block_end = count & LAZY ? first + LAZY_BLOCK_SIZE : NO_NODE;
+}
+
+/**
+ * returns the index of the next child, or NO_NODE once they've all been
+ * walked
+ */
+uint32_t Children_next(struct Children* children)
+{
+    if (!children->left) {
+        return NO_NODE;
+    }
+
+    if (children->next == children->block_end) {
+        const struct Node* end = NodeArena_node(children->arena, children->block_end);
+        children->next = __atomic_load_n(&end->children, __ATOMIC_ACQUIRE);
+        children->block_size *= 2;
+        children->block_end = children->next + children->block_size;
+    }
+
+    children->left--;
+    return children->next++;
+}
+
+/**
+ * copies the subtree under a node into another arena, and returns the
+ * root's new index. Links to nodes outside the subtree become nodes that
+ * haven't been expanded. If the root was expanded lazily, its children
+ * are laid out in full, one for each of its position's actions, as a
+ * search's root has them.
+ */
+uint32_t NodeArena_copy_tree(struct NodeArena* dest,
+    const struct NodeArena* source,
+    uint32_t rooti,
+    uint_fast16_t action_count)
+{
+    // Where each node of the subtree went
+    uint32_t* moved = checked_realloc(NULL, sizeof(uint32_t) * source->size);
+    memset(moved, 0xFF, sizeof(uint32_t) * source->size);
+
+    // Copies left to expand, as their children still have source indices
+    uint32_t stack_size = 1024;
+    uint32_t* stack = checked_realloc(NULL, sizeof(uint32_t) * stack_size);
+    uint32_t stack_count = 0;
+
+    uint32_t links_size = 64;
+    uint32_t* links = checked_realloc(NULL, sizeof(uint32_t) * links_size);
+    uint32_t link_count = 0;
+
+    uint32_t copyi = NodeArena_alloc(dest, 1);
+    struct Node* root = NodeArena_node(dest, copyi);
+    *root = *NodeArena_node(source, rooti);
+    moved[rooti] = copyi;
+    stack[stack_count++] = copyi;
+
+    if (root->children != NO_CHILDREN && root->children_count & LAZY) {
+        uint32_t childreni = NodeArena_alloc(dest, action_count);
+        for (int i = 0; i < action_count; i++) {
+            *NodeArena_node(dest, childreni + i) = (struct Node) { .children = NO_CHILDREN, .action = i };
+        }
+
+        struct Children children;
+        Children_start(&children, source, NodeArena_node(source, rooti));
+        uint32_t childi;
+        while ((childi = Children_next(&children)) != NO_NODE) {
+            uint16_t action = NodeArena_node(source, childi)->action;
+            *NodeArena_node(dest, childreni + action) = *NodeArena_node(source, childi);
+            moved[childi] = childreni + action;
+        }
+
+        stack_count = 0;
+        for (int i = 0; i < action_count; i++) {
+            stack[stack_count++] = childreni + i;
+        }
+        root->children = childreni;
+        root->children_count = action_count;
+        root->virtual_visits = 0;
+    }
+
+    while (stack_count) {
+        struct Node* node = NodeArena_node(dest, stack[--stack_count]);
+        node->virtual_visits = 0;
+
+        if (node->children == NO_CHILDREN) {
+            continue;
+        }
+
+        if (node->children_count == LINK) {
+            if (link_count == links_size) {
+                links_size *= 2;
+                links = checked_realloc(links, sizeof(uint32_t) * links_size);
+            }
+            links[link_count++] = stack[stack_count];
+            continue;
+        }
+
+        if (node->children_count & LAZY) {
+            uint16_t count = node->children_count & ~LAZY;
+            uint32_t* next = &node->children;
+            uint32_t blocki = node->children;
+            for (uint32_t block_size = LAZY_BLOCK_SIZE, copied = 0; copied < count; copied += block_size, block_size *= 2) {
+                if (stack_count + block_size > stack_size) {
+                    stack_size = 2 * (stack_count + block_size);
+                    stack = checked_realloc(stack, sizeof(uint32_t) * stack_size);
+                }
+
+                uint32_t copyi = NodeArena_alloc(dest, block_size + 1);
+                for (uint32_t i = 0; i < block_size; i++) {
+                    *NodeArena_node(dest, copyi + i) = *NodeArena_node(source, blocki + i);
+                    moved[blocki + i] = copyi + i;
+                    stack[stack_count++] = copyi + i;
+                }
+                struct Node* end = NodeArena_node(dest, copyi + block_size);
+                *end = *NodeArena_node(source, blocki + block_size);
+                end->children = NO_CHILDREN;
+
+                *next = copyi;
+                next = &end->children;
+                blocki = NodeArena_node(source, blocki + block_size)->children;
+            }
+            continue;
+        }
+
+        if (stack_count + node->children_count > stack_size) {
+            stack_size = 2 * (stack_count + node->children_count);
+            stack = checked_realloc(stack, sizeof(uint32_t) * stack_size);
+        }
+
+        uint32_t childreni = NodeArena_alloc(dest, node->children_count);
+        for (int i = 0; i < node->children_count; i++) {
+            *NodeArena_node(dest, childreni + i) = *NodeArena_node(source, node->children + i);
+            moved[node->children + i] = childreni + i;
+            stack[stack_count++] = childreni + i;
+        }
+        node->children = childreni;
+    }
+
+    for (uint32_t i = 0; i < link_count; i++) {
+        struct Node* link = NodeArena_node(dest, links[i]);
+        link->children = moved[link->children];
+        if (link->children == NO_NODE) {
+            link->children_count = 0;
+        }
+    }
+
+    free(moved);
+    free(stack);
+    free(links);
+    return copyi;
+}
+
+void NodeTable_init(struct NodeTable* table, int bits)
+{
+    table->entries = calloc((size_t)1 << bits, sizeof(uint64_t));
+    if (table->entries == NULL) {
+        fprintf(stderr, "ERROR: failure to malloc in MCTS\n");
+        exit(1);
+    }
+    table->mask = ((uint64_t)1 << bits) - 1;
+}
+
+/**
+ * returns the node for the position with the given hash, adding the given
+ * node for it if there isn't one yet. If there's no room for it, the given
+ * node is returned without being added.
+ */
+uint32_t NodeTable_find_or_add(struct NodeTable* table, uint64_t hash, uint32_t nodei)
+{
+    uint64_t key = hash & ~(uint64_t)UINT32_MAX;
+    uint64_t entry = key | nodei;
+    // An all-zero entry would read as empty
+    if (entry == 0) {
+        return nodei;
+    }
+
+    for (int i = 0; i < NODE_TABLE_PROBES; i++) {
+        uint64_t* slot = &table->entries[(hash + i) & table->mask];
+        uint64_t found = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if (found == 0) {
+            if (__atomic_compare_exchange_n(slot, &found, entry, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return nodei;
+            }
+        }
+        if ((found & ~(uint64_t)UINT32_MAX) == key) {
+            return found & UINT32_MAX;
+        }
+    }
+
+    return nodei;
+}
+
+void NodeTable_free(struct NodeTable* table)
+{
+    free(table->entries);
+    table->entries = NULL;
+}
+
+/**
+ * adds to a node's visits and value, atomically if it's shared with
+ * other threads
+ */
+void Node_add(struct Node* node, int visits, float value, bool shared)
+{
+    if (!shared) {
+        node->visits += visits;
+        node->value += value;
+        return;
+    }
+
+    __atomic_fetch_add(&node->visits, visits, __ATOMIC_RELAXED);
+    float old;
+    __atomic_load(&node->value, &old, __ATOMIC_RELAXED);
+    float new;
+    do {
+        new = old + value;
+    } while (!__atomic_compare_exchange(&node->value, &old, &new, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void Node_init(struct Node* node, uint16_t action, uint16_t depth, struct MCTSStats* stats)
 {
-    node->expanded = false;
     node->visits = 0;
     node->value = 0;
-    // TODO we probably could pass this around mcts() and iterate()
-    // instead of storing it here
-    node->depth = depth;
+    node->virtual_visits = 0;
+    node->children = NO_CHILDREN;
+    node->children_count = 0;
+    node->action = action;
+    node->prior = 0;
+
+    stats->nodes++;
+    if (depth > stats->tree_depth) {
+        stats->tree_depth = depth;
+    }
+}
 
-    results->stats.nodes++;
-    if (depth > results->stats.tree_depth) {
-        results->stats.tree_depth = depth;
+/**
+ * sets the priors of a fully expanded node's children, for PUCT
+ */
+void Node_set_priors(struct MCTSContext* context, struct Node* children, const struct State* state)
+{
+    float priors[MAX_ACTIONS];
+    context->options->prior(state, context->options, priors);
+    for (int i = 0; i < state->action_count; i++) {
+        children[i].prior = priors[i];
     }
 }
 
 /**
- * allocates space for children pointers and the child nodes themselves,
- * and calls Node_init on each child
+ * allocates a block for the child nodes, calls Node_init on each child,
+ * and then publishes them. If another thread has expanded the node in the
+ * meantime, its children are kept, and the new block is left unused.
  */
-void Node_expand(struct Node* node, const struct State* state)
+void Node_expand(struct MCTSContext* context, struct Node* node, const struct State* state)
 {
-    node->children_count = state->action_count;
-    node->children = mctsmalloc(sizeof(struct Node*) * node->children_count);
+    uint32_t childreni = NodeArena_alloc(context->arena, state->action_count);
 
+    struct Node* children = NodeArena_node(context->arena, childreni);
     for (int i = 0; i < state->action_count; i++) {
-        node->children[i] = mctsmalloc(sizeof(struct Node));
-        Node_init(node->children[i], node->depth + 1);
+        Node_init(&children[i], i, context->depth + 1, &context->stats);
     }
+    if (context->options->puct) {
+        Node_set_priors(context, children, state);
+    }
+
+    uint32_t expected = NO_CHILDREN;
+    if (__atomic_compare_exchange_n(&node->children, &expected, childreni,
+            false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&node->children_count, state->action_count, __ATOMIC_RELEASE);
+    } else {
+        context->stats.nodes -= state->action_count;
+    }
+}
 
-    node->expanded = true;
+int compare_ranks(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
 }
 
 /**
- * frees the node's children along with the node
+ * opens the child of a lazily expanded node after the given number that
+ * are already open, and returns its index. Children are opened in order
+ * of prior, highest first, and of action on a tie. They're in a chain of
+ * blocks, each followed by a node whose children is the index of the
+ * next; a block is allocated and published like Node_expand's children
+ * when its first child is opened, with its children's actions and priors
+ * already set, so the priors are only found once per block. Threads
+ * opening the same child at once get the same child, whichever of them
+ * counts it first.
  */
-void Node_free(struct Node* node)
+uint32_t Node_open(struct MCTSContext* context, struct Node* node, uint16_t opened, const struct State* state)
 {
-    if (node->expanded) {
-        for (int i = 0; i < node->children_count; i++) {
-            Node_free(node->children[i]);
+    uint32_t* next = &node->children;
+    uint32_t block_size = LAZY_BLOCK_SIZE;
+    uint32_t offset = opened;
+    while (offset >= block_size) {
+        uint32_t blocki = __atomic_load_n(next, __ATOMIC_ACQUIRE);
+        next = &NodeArena_node(context->arena, blocki + block_size)->children;
+        offset -= block_size;
+        block_size *= 2;
+    }
+
+    uint32_t blocki = __atomic_load_n(next, __ATOMIC_ACQUIRE);
+    if (blocki == NO_CHILDREN) {
+        // Ranks sort by prior, as the bits of a non-negative float do,
+        // and then by action
+        float priors[MAX_ACTIONS];
+        context->options->prior(state, context->options, priors);
+        uint64_t ranks[MAX_ACTIONS];
+        for (int a = 0; a < state->action_count; a++) {
+            uint32_t bits;
+            memcpy(&bits, &priors[a], sizeof(bits));
+            ranks[a] = (uint64_t)(uint32_t)~bits << 16 | a;
+        }
+        qsort(ranks, state->action_count, sizeof(uint64_t), compare_ranks);
+
+        uint32_t newi = NodeArena_alloc(context->arena, block_size + 1);
+        struct Node* block = NodeArena_node(context->arena, newi);
+        for (uint32_t i = 0; i <= block_size; i++) {
+            uint32_t rank = opened - offset + i;
+            uint16_t action = rank < state->action_count ? (uint16_t)ranks[rank] : NO_ACTION;
+            if (i < block_size) {
+                Node_init(&block[i], action, context->depth + 1, &context->stats);
+            } else {
+                block[i] = (struct Node) { .children = NO_CHILDREN, .action = action };
+            }
+            if (action != NO_ACTION) {
+                block[i].prior = priors[action];
+            }
+        }
+
+        if (__atomic_compare_exchange_n(next, &blocki, newi,
+                false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            blocki = newi;
+        } else {
+            context->stats.nodes -= block_size;
         }
-        free(node->children);
     }
 
-    free(node);
+    uint32_t childi = blocki + offset;
+    uint16_t expected = opened ? LAZY | opened : 0;
+    __atomic_compare_exchange_n(&node->children_count, &expected, LAZY | (opened + 1),
+        false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    return childi;
 }
 
 /**
- * single MCTS iteration: recursively walk down tree with state
- * (choosing promising children), simulate when we get to the end of the
- * tree, and update visited nodes with the results
+ * returns whether a node has a child for each of its position's actions,
+ * and each is a proven win, making the node a proven loss
  */
-float iterate(struct Node* root, struct State* state)
+bool Node_proven_loss(const struct NodeArena* arena, const struct Node* node, uint_fast16_t action_count)
 {
-    // Treat a state that has a winning moves as game-terminal
-    if (state->winning_action) {
-        root->visits++;
-        root->value += 1.0;
-        return 1.0;
+    struct Children children;
+    Children_start(&children, arena, node);
+    if (children.left != action_count) {
+        return false;
     }
 
-    if (state->result == DRAW) {
-        return 0.0;
+    uint32_t childi;
+    while ((childi = Children_next(&children)) != NO_NODE) {
+        float value;
+        __atomic_load(&NodeArena_node(arena, childi)->value, &value, __ATOMIC_RELAXED);
+        if (value != INFINITY) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * returns the index of the node that a node is a link to, or NO_CHILDREN
+ * if it isn't a link
+ */
+uint32_t Node_linked(const struct Node* node)
+{
+    uint32_t nodei = __atomic_load_n(&node->children, __ATOMIC_ACQUIRE);
+    if (nodei == NO_CHILDREN || __atomic_load_n(&node->children_count, __ATOMIC_RELAXED) != LINK) {
+        return NO_CHILDREN;
     }
+    return nodei;
+}
 
-    if (!root->expanded) {
-        Node_expand(root, state);
+/**
+ * in graph search, makes a node that hasn't been expanded a link to the
+ * node first reached for its position, if that's another node. Every
+ * thread gets the same answer from the table, so no thread can expand a
+ * node that another makes a link.
+ */
+void Node_link(struct MCTSContext* context, uint32_t nodei, const struct State* state)
+{
+    uint32_t linki = NodeTable_find_or_add(context->table, State_hash(state), nodei);
+    if (linki == nodei) {
+        return;
     }
 
-    if (root->visits == 0) {
-        float score = State_simulate(state, &options, &results->stats);
+    struct Node* node = NodeArena_node(context->arena, nodei);
+    __atomic_store_n(&node->children_count, LINK, __ATOMIC_RELAXED);
+    __atomic_store_n(&node->children, linki, __ATOMIC_RELEASE);
+    context->stats.transpositions++;
+}
 
-        root->visits++;
-        root->value += score;
-        return score;
+/**
+ * returns the mean value of the node a child is a link to, as it says
+ * more about the position than the link does, or the given mean of the
+ * child itself if it isn't a link or the node hasn't been visited
+ */
+float Node_link_mean(struct MCTSContext* context, const struct Node* child, float mean)
+{
+    uint32_t linki = Node_linked(child);
+    if (linki == NO_CHILDREN) {
+        return mean;
+    }
+
+    struct Node* node = NodeArena_node(context->arena, linki);
+    unsigned int visits = __atomic_load_n(&node->visits, __ATOMIC_RELAXED);
+    if (!visits) {
+        return mean;
     }
+    float value;
+    __atomic_load(&node->value, &value, __ATOMIC_RELAXED);
+    return value / visits;
+}
+
+/**
+ * returns the UCT score of a child that's been visited, from the view of
+ * its parent, given the log of the parent's visits
+ */
+float Node_uct(struct MCTSContext* context,
+    const struct Node* child,
+    unsigned int visits,
+    float log_parent_visits)
+{
+    float value;
+    __atomic_load(&child->value, &value, __ATOMIC_RELAXED);
+    float mean = value / visits;
+    if (context->table) {
+        mean = Node_link_mean(context, child, mean);
+    }
+
+    return -1 * mean + context->options->uctc * sqrtf(log_parent_visits / visits);
+}
+
+#ifdef __SSE2__
+/**
+ * picks the index of a node's child with the best UCT score, as the
+ * scalar loop in iterate does, four children at a time. The nodes are
+ * read without atomics, so it's only for a tree that no other thread is
+ * searching, and it doesn't look through links. The arithmetic is the
+ * same, so it picks the same child.
+ */
+int Node_select_uct_sse(const struct Node* children, int count, float uctc, float log_parent_visits)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 c = _mm_set1_ps(uctc);
+    const __m128 log_visits = _mm_set1_ps(log_parent_visits);
+
+    __m128 best = _mm_set1_ps(-INFINITY);
+    __m128i besti = _mm_set1_epi32(-1);
+    __m128i indices = _mm_setr_epi32(0, 1, 2, 3);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // Put together in registers, as _mm_setr_epi32 is compiled to
+        // stores and a reload that stalls
+        __m128i visits = _mm_unpacklo_epi64(
+            _mm_unpacklo_epi32(_mm_cvtsi32_si128(children[i].visits), _mm_cvtsi32_si128(children[i + 1].visits)),
+            _mm_unpacklo_epi32(_mm_cvtsi32_si128(children[i + 2].visits), _mm_cvtsi32_si128(children[i + 3].visits)));
+        int unvisited = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(visits, _mm_setzero_si128())));
+        if (unvisited) {
+            return i + __builtin_ctz(unvisited);
+        }
+
+        __m128 value = _mm_setr_ps(children[i].value, children[i + 1].value,
+            children[i + 2].value, children[i + 3].value);
+        __m128 n = _mm_cvtepi32_ps(visits);
+        __m128 mean = _mm_div_ps(value, n);
+        __m128 uct = _mm_add_ps(_mm_xor_ps(mean, sign),
+            _mm_mul_ps(c, _mm_sqrt_ps(_mm_div_ps(log_visits, n))));
+
+        // Later children win ties, as in the scalar loop
+        __m128 better = _mm_cmpge_ps(uct, best);
+        best = _mm_or_ps(_mm_and_ps(better, uct), _mm_andnot_ps(better, best));
+        besti = _mm_or_si128(_mm_and_si128(_mm_castps_si128(better), indices),
+            _mm_andnot_si128(_mm_castps_si128(better), besti));
+        indices = _mm_add_epi32(indices, _mm_set1_epi32(4));
+    }
+
+    float lanes[4];
+    int lane_indices[4];
+    _mm_storeu_ps(lanes, best);
+    _mm_storeu_si128((__m128i*)lane_indices, besti);
 
     int childi = 0;
     float best_uct = -INFINITY;
-    for (int i = 0; i < state->action_count; i++) {
-        if (root->children[i]->visits == 0) {
+    bool found = false;
+    for (int lane = 0; lane < 4; lane++) {
+        if (lane_indices[lane] < 0) {
+            continue;
+        }
+        if (!found || lanes[lane] > best_uct
+            || (lanes[lane] == best_uct && lane_indices[lane] > childi)) {
+            best_uct = lanes[lane];
+            childi = lane_indices[lane];
+            found = true;
+        }
+    }
+
+    for (; i < count; i++) {
+        if (children[i].visits == 0) {
+            return i;
+        }
+
+        float uct = -1 * (children[i].value / children[i].visits)
+            + uctc * sqrtf(log_parent_visits / children[i].visits);
+        if (uct >= best_uct) {
+            best_uct = uct;
             childi = i;
-            break;
         }
+    }
+
+    return childi;
+}
+#endif
+
+/**
+ * picks the index of the child with the best UCT score from a node's
+ * children, or of the first that hasn't been visited
+ */
+int Node_select_uct(struct MCTSContext* context, const struct Node* children, int count, unsigned int visits)
+{
+    // The log is the same for every child
+    float log_visits = logf(visits);
+
+#ifdef __SSE2__
+    if (!context->shared && !context->table) {
+        return Node_select_uct_sse(children, count, context->options->uctc, log_visits);
+    }
+#endif
 
-        float uct = -1 * root->children[i]->value / root->children[i]->visits + options.uctc * sqrtf(logf(root->visits) / root->children[i]->visits);
+    int childi = 0;
+    float best_uct = -INFINITY;
+    for (int i = 0; i < count; i++) {
+        unsigned int child_visits = __atomic_load_n(&children[i].visits, __ATOMIC_RELAXED);
+        if (child_visits == 0) {
+            return i;
+        }
 
+        float uct = Node_uct(context, &children[i], child_visits, log_visits);
         if (uct >= best_uct) {
             best_uct = uct;
             childi = i;
         }
     }
 
-    struct Node* child = root->children[childi];
-    State_act(state, &state->actions[childi]);
+    return childi;
+}
+
+/**
+ * picks a child of a node by PUCT, and returns its index. Children that
+ * haven't been visited are valued as the node itself is. If the node is
+ * expanded lazily, and the unopened action with the highest prior comes
+ * out ahead of its children, that action's child is opened for it.
+ */
+uint32_t Node_select_puct(struct MCTSContext* context, struct Node* node, const struct State* state)
+{
+    const struct MCTSOptions* options = context->options;
+
+    unsigned int visits = __atomic_load_n(&node->visits, __ATOMIC_RELAXED);
+    float value;
+    __atomic_load(&node->value, &value, __ATOMIC_RELAXED);
+    float first_play = value / visits;
+    float exploration = options->puctc * sqrtf(visits);
+
+    struct Children children;
+    Children_start(&children, context->arena, node);
+    uint16_t opened_count = children.left;
+
+    uint32_t best = NO_NODE;
+    float best_puct = -INFINITY;
+    uint32_t childi;
+    while ((childi = Children_next(&children)) != NO_NODE) {
+        struct Node* child = NodeArena_node(context->arena, childi);
+
+        unsigned int child_visits = __atomic_load_n(&child->visits, __ATOMIC_RELAXED);
+        float mean = -first_play;
+        if (child_visits) {
+            float child_value;
+            __atomic_load(&child->value, &child_value, __ATOMIC_RELAXED);
+            mean = child_value / child_visits;
+            if (context->table) {
+                mean = Node_link_mean(context, child, mean);
+            }
+        }
+
+        float puct = -1 * mean + exploration * child->prior / (1 + child_visits);
+        if (best == NO_NODE || puct > best_puct) {
+            best_puct = puct;
+            best = childi;
+        }
+    }
+
+    // Past the open children is the node with the next action to open,
+    // unless there are none yet
+    if (children.lazy && opened_count < state->action_count) {
+        if (best == NO_NODE) {
+            best = Node_open(context, node, opened_count, state);
+        } else {
+            float prior = NodeArena_node(context->arena, children.next)->prior;
+            if (first_play + exploration * prior > best_puct) {
+                best = Node_open(context, node, opened_count, state);
+            }
+        }
+    }
+
+    return best;
+}
+
+/**
+ * picks a child of a lazily expanded node by UCT, among as many as
+ * progressive widening allows for the node's visits. If that's more than
+ * are open, the child for the unopened action with the highest prior is
+ * opened and picked, as it hasn't been visited.
+ */
+uint32_t Node_select_widening(struct MCTSContext* context,
+    struct Node* node,
+    const struct State* state,
+    unsigned int visits)
+{
+    const struct MCTSOptions* options = context->options;
+
+    struct Children children;
+    Children_start(&children, context->arena, node);
+
+    uint16_t opened_count = children.left;
+    float widening = ceilf(options->widening_c * powf(visits, options->widening_exponent));
+    if (opened_count < widening && opened_count < state->action_count) {
+        return Node_open(context, node, opened_count, state);
+    }
+
+    uint32_t best = NO_NODE;
+    float best_uct = -INFINITY;
+    float log_visits = logf(visits);
+    uint32_t childi;
+    while ((childi = Children_next(&children)) != NO_NODE) {
+        struct Node* child = NodeArena_node(context->arena, childi);
+        unsigned int child_visits = __atomic_load_n(&child->visits, __ATOMIC_RELAXED);
+        if (child_visits == 0) {
+            return childi;
+        }
+
+        float uct = Node_uct(context, child, child_visits, log_visits);
+        if (best == NO_NODE || uct >= best_uct) {
+            best_uct = uct;
+            best = childi;
+        }
+    }
+
+    return best;
+}
+
+float iterate(struct MCTSContext* context, uint32_t rooti, struct State* state);
+
+/**
+ * takes an iteration through a link to the node it's an edge to. While
+ * the link has fewer visits than the node, the node's mean value is
+ * backed up through the link instead of searching further, so that what
+ * the link reports catches up with what's known about the position.
+ * Coming back around to a position already on the path scores a draw.
+ */
+float Node_follow(struct MCTSContext* context, struct Node* link, uint32_t nodei, struct State* state)
+{
+    struct Node* node = NodeArena_node(context->arena, nodei);
+    uint64_t hash = State_hash(state);
+
+    bool repeated = context->path_length == MAX_GRAPH_PATH;
+    for (int i = 0; i < context->path_length && !repeated; i++) {
+        repeated = context->path[i] == hash;
+    }
+
+    float score = 0.0;
+    if (!repeated) {
+        unsigned int link_visits = __atomic_load_n(&link->visits, __ATOMIC_RELAXED)
+            - __atomic_load_n(&link->virtual_visits, __ATOMIC_RELAXED);
+        unsigned int visits = __atomic_load_n(&node->visits, __ATOMIC_RELAXED);
+        unsigned int node_visits = visits - __atomic_load_n(&node->virtual_visits, __ATOMIC_RELAXED);
 
-    float score = -1 * iterate(child, state);
+        if (link_visits < node_visits) {
+            float value;
+            __atomic_load(&node->value, &value, __ATOMIC_RELAXED);
+            score = value / visits;
+        } else {
+            score = iterate(context, nodei, state);
+        }
+    }
 
-    root->visits++;
-    root->value += score;
+    Node_add(link, 1, score, context->shared);
     return score;
 }
 
+/**
+ * single MCTS iteration: recursively walk down tree with state
+ * (choosing promising children), simulate when we get to the end of the
+ * tree, and update visited nodes with the results
+ *
+ * the state is walked back up with State_unact, so its core information
+ * is unchanged on return, but its cut points and actions are stale
+ */
+float iterate(struct MCTSContext* context, uint32_t rooti, struct State* state)
+{
+    struct Node* root = NodeArena_node(context->arena, rooti);
+
+    if (context->options->solver) {
+        float value;
+        __atomic_load(&root->value, &value, __ATOMIC_RELAXED);
+        if (isinf(value)) {
+            Node_add(root, 1, value, context->shared);
+            return value;
+        }
+    }
+
+    State_derive_actions(state);
+
+    // Treat a state that has a winning moves as game-terminal, and with
+    // the solver, as a proven win
+    if (state->winning_action != NO_ACTION) {
+        float score = context->options->solver ? INFINITY : 1.0;
+        Node_add(root, 1, score, context->shared);
+        return score;
+    }
+
+    if (state->result == DRAW) {
+        return 0.0;
+    }
+
+    uint32_t childreni = __atomic_load_n(&root->children, __ATOMIC_ACQUIRE);
+    if (context->table) {
+        if (childreni == NO_CHILDREN) {
+            Node_link(context, rooti, state);
+        }
+        uint32_t linki = Node_linked(root);
+        if (linki != NO_CHILDREN) {
+            return Node_follow(context, root, linki, state);
+        }
+        childreni = __atomic_load_n(&root->children, __ATOMIC_ACQUIRE);
+    }
+    if (childreni == NO_CHILDREN && !MCTSOptions_lazy(context->options)) {
+        Node_expand(context, root, state);
+        childreni = __atomic_load_n(&root->children, __ATOMIC_ACQUIRE);
+    }
+
+    unsigned int root_visits = __atomic_load_n(&root->visits, __ATOMIC_RELAXED);
+    if (root_visits == __atomic_load_n(&root->virtual_visits, __ATOMIC_RELAXED)) {
+        float score = State_simulate(state, context);
+
+        Node_add(root, 1, score, context->shared);
+        return score;
+    }
+
+    uint32_t childi;
+    uint16_t actioni = 0;
+    if (MCTSOptions_lazy(context->options)) {
+        childi = context->options->puct
+            ? Node_select_puct(context, root, state)
+            : Node_select_widening(context, root, state, root_visits);
+        actioni = __atomic_load_n(&NodeArena_node(context->arena, childi)->action, __ATOMIC_RELAXED);
+    } else {
+        struct Node* children = NodeArena_node(context->arena, childreni);
+        actioni = Node_select_uct(context, children, state->action_count, root_visits);
+        childi = childreni + actioni;
+    }
+
+    struct Node* child = NodeArena_node(context->arena, childi);
+    // Actions are stale once the state is walked back up
+    uint_fast16_t action_count = state->action_count;
+
+    bool on_path = context->table && context->path_length < MAX_GRAPH_PATH;
+    if (on_path) {
+        context->path[context->path_length++] = State_hash(state);
+    }
+    context->depth++;
+
+    struct Undo undo;
+    State_act_undoable(state, &state->actions[actioni], &undo);
+
+    if (context->shared) {
+        __atomic_fetch_add(&child->virtual_visits, 1, __ATOMIC_RELAXED);
+        Node_add(child, 1, VIRTUAL_LOSS, true);
+    }
+    float score = -1 * iterate(context, childi, state);
+    if (context->shared) {
+        Node_add(child, -1, -VIRTUAL_LOSS, true);
+        __atomic_fetch_sub(&child->virtual_visits, 1, __ATOMIC_RELAXED);
+    }
+    State_unact(state, &undo);
+
+    if (on_path) {
+        context->path_length--;
+    }
+    context->depth--;
+
+    // A move to a proven loss proves a win. A move to a proven win only
+    // proves a loss if every other move is one too; otherwise it's backed
+    // up as an ordinary loss.
+    if (isinf(score) && score < 0 && !Node_proven_loss(context->arena, root, action_count)) {
+        score = -1.0;
+    }
+
+    Node_add(root, 1, score, context->shared);
+    return score;
+}
+
+void MCTSStats_add(struct MCTSStats* stats, const struct MCTSStats* other)
+{
+    stats->iterations += other->iterations;
+    stats->nodes += other->nodes;
+    if (other->tree_depth > stats->tree_depth) {
+        stats->tree_depth = other->tree_depth;
+    }
+    if (stats->simulations == 0) {
+        stats->mean_sim_depth = other->mean_sim_depth;
+    } else if (other->simulations) {
+        stats->mean_sim_depth = (stats->mean_sim_depth * stats->simulations
+                                    + other->mean_sim_depth * other->simulations)
+            / (stats->simulations + other->simulations);
+    }
+    stats->simulations += other->simulations;
+    stats->cut_point_terminations += other->cut_point_terminations;
+    stats->depth_outs += other->depth_outs;
+    stats->eval_outs += other->eval_outs;
+    stats->light_plies += other->light_plies;
+    for (int i = 0; i < NUM_POLICY_CATEGORIES; i++) {
+        stats->policy_picks[i] += other->policy_picks[i];
+    }
+    stats->transpositions += other->transpositions;
+}
+
+/**
+ * runs iterations on the thread's tree until the limits are reached; the
+ * first thread also keeps track of when its pick of action last changed.
+ * With root parallelism, the root's children are then added into the
+ * results' nodes.
+ */
+void mcts_thread(void* arg, int i)
+{
+    struct MCTSContext* context = &((struct MCTSContext*)arg)[i];
+    const struct State* state = context->state;
+    struct Node* root = NodeArena_node(context->arena, context->root);
+    struct Node* children = NodeArena_node(context->arena, root->children);
+
+    // A single working state is walked down and back up the tree each
+    // iteration. Walking back up leaves the root's actions stale, and
+    // copying back just those is cheaper than deriving them again.
+    struct State s;
+    State_copy(state, &s);
+
+    int last_actioni = -1;
+    while (1) {
+        iterate(context, context->root, &s);
+        State_copy_actions(state, &s);
+        context->stats.iterations++;
+
+        if (context->first) {
+            float best_score = -INFINITY;
+            int actioni = 0;
+            for (int a = 0; a < state->action_count; a++) {
+                float value;
+                __atomic_load(&children[a].value, &value, __ATOMIC_RELAXED);
+                float score = -1 * value / __atomic_load_n(&children[a].visits, __ATOMIC_RELAXED);
+
+                if (score >= best_score) {
+                    best_score = score;
+                    actioni = a;
+                }
+            }
+
+            if (last_actioni != actioni) {
+                context->stats.change_iterations = context->stats.iterations;
+            }
+            last_actioni = actioni;
+        }
+
+        if (context->options->seconds) {
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            uint64_t elapsed = now.tv_sec - context->start.tv_sec;
+            if (elapsed > context->options->seconds) {
+                break;
+            }
+        }
+        if (context->options->iterations) {
+            if (context->stats.iterations == context->options->iterations) {
+                break;
+            }
+        }
+
+        // There's nothing left to learn once the root is proven
+        float value;
+        __atomic_load(&root->value, &value, __ATOMIC_RELAXED);
+        if (isinf(value)) {
+            break;
+        }
+    }
+
+    if (context->options->root_parallel) {
+        for (int a = 0; a < state->action_count; a++) {
+            Node_add(&context->results->nodes[a], children[a].visits, children[a].value, true);
+        }
+    }
+}
+
 void mcts(const struct State* state,
-    struct MCTSResults* r,
+    struct MCTSResults* results,
     const struct MCTSOptions* o)
 {
-    results = r;
-    memset(results, 0, sizeof(struct MCTSResults));
-
+    struct MCTSOptions options;
     if (o == NULL) {
         MCTSOptions_default(&options);
     } else {
         options = *o;
     }
 
+    uint32_t saved_tree = NO_NODE;
+    struct NodeArena saved_arena;
+    if (options.reuse_tree && results->tree != NO_NODE) {
+        NodeArena_move(&saved_arena, &results->arena);
+        struct Node* root = NodeArena_node(&saved_arena, results->tree);
+        if (results->tree_hash == State_hash(state)
+            && results->tree_lazy == MCTSOptions_lazy(&options)
+            && root->children != NO_CHILDREN
+            && root->children_count == state->action_count) {
+            saved_tree = results->tree;
+        } else {
+            NodeArena_free(&saved_arena);
+        }
+    }
+
+    memset(results, 0, sizeof(struct MCTSResults));
+    results->tree = NO_NODE;
+
     if (state->action_count == 0) {
         fprintf(stderr, "Can't run MCTS on state with no actions\n");
+        if (saved_tree != NO_NODE) {
+            NodeArena_free(&saved_arena);
+        }
         return;
     }
 
-    struct Node* root = mctsmalloc(sizeof(struct Node));
-    Node_init(root, 0);
-    Node_expand(root, state);
+    int thread_count = options.threads > 1 ? options.threads : 1;
+    struct MCTSContext contexts[thread_count];
+    // Trees of the threads after the first, with root parallelism
+    struct NodeArena arenas[thread_count];
+    // Each tree's node table, in graph search; there's a new node to add
+    // for most iterations, and the table is kept at most half full
+    struct NodeTable tables[thread_count];
+    int table_bits = DEFAULT_NODE_TABLE_BITS;
+    if (options.iterations) {
+        uint64_t entries = 2 * options.iterations * (options.root_parallel ? 1 : thread_count);
+        table_bits = MIN_NODE_TABLE_BITS;
+        while (table_bits < MAX_NODE_TABLE_BITS && ((uint64_t)1 << table_bits) < entries) {
+            table_bits++;
+        }
+    }
 
     struct timeval start;
     gettimeofday(&start, NULL);
+    for (int i = 0; i < thread_count; i++) {
+        struct MCTSContext* context = &contexts[i];
+        context->options = &options;
+        context->results = results;
+        context->first = i == 0;
+        context->shared = thread_count > 1 && !options.root_parallel;
+        context->state = state;
+        context->start = start;
+        Rng_seed(&context->rng, options.seed + i);
+        memset(&context->stats, 0, sizeof(struct MCTSStats));
+        context->path_length = 0;
+        context->depth = 0;
 
-    int last_actioni = -1;
-    while (1) {
-        struct State s;
-        State_copy(state, &s);
-        iterate(root, &s);
-        results->stats.iterations++;
-
-        results->score = -INFINITY;
-        for (int a = 0; a < state->action_count; a++) {
-            float score = -1 * root->children[a]->value / root->children[a]->visits;
+        if (i > 0 && !options.root_parallel) {
+            context->arena = contexts[0].arena;
+            context->table = contexts[0].table;
+            context->root = contexts[0].root;
+            continue;
+        }
 
-            if (score >= results->score) {
-                results->score = score;
-                results->actioni = a;
+        context->arena = i == 0 ? &results->arena : &arenas[i];
+        if (i == 0 && saved_tree != NO_NODE) {
+            NodeArena_move(context->arena, &saved_arena);
+            context->root = saved_tree;
+            struct Node* root = NodeArena_node(context->arena, saved_tree);
+            results->stats.reused_visits = root->visits;
+            // Children the root hadn't opened, before it was the root,
+            // are laid out without priors
+            if (options.puct) {
+                Node_set_priors(context, NodeArena_node(context->arena, root->children), state);
             }
+        } else {
+            NodeArena_init(context->arena);
+            context->root = NodeArena_alloc(context->arena, 1);
+            struct Node* root = NodeArena_node(context->arena, context->root);
+            Node_init(root, NO_ACTION, 0, &context->stats);
+            Node_expand(context, root, state);
         }
 
-        if (last_actioni != results->actioni) {
-            results->stats.change_iterations = results->stats.iterations;
+        context->table = NULL;
+        if (options.graph) {
+            context->table = &tables[i];
+            NodeTable_init(context->table, table_bits);
+            NodeTable_find_or_add(context->table, State_hash(state), context->root);
         }
-        last_actioni = results->actioni;
+    }
 
-        if (options.seconds) {
-            struct timeval now;
-            gettimeofday(&now, NULL);
-            uint64_t elapsed = now.tv_sec - start.tv_sec;
-            if (elapsed > options.seconds) {
-                break;
+    pool_run(thread_count, mcts_thread, contexts);
+
+    results->stats.change_iterations = contexts[0].stats.change_iterations;
+    for (int i = 0; i < thread_count; i++) {
+        MCTSStats_add(&results->stats, &contexts[i].stats);
+        if (i == 0 || options.root_parallel) {
+            results->stats.tree_bytes += contexts[i].arena->bytes;
+            if (options.graph) {
+                results->stats.tree_bytes += sizeof(uint64_t) << table_bits;
+                NodeTable_free(contexts[i].table);
             }
         }
-        if (options.iterations) {
-            if (results->stats.iterations == options.iterations) {
-                break;
-            }
+        if (i > 0 && options.root_parallel) {
+            NodeArena_free(&arenas[i]);
+        }
+    }
+
+    if (!options.root_parallel) {
+        struct Node* root = NodeArena_node(&results->arena, contexts[0].root);
+        struct Node* children = NodeArena_node(&results->arena, root->children);
+        for (int a = 0; a < state->action_count; a++) {
+            results->nodes[a] = children[a];
         }
     }
 
@@ -217,14 +1221,70 @@ void mcts(const struct State* state,
     gettimeofday(&end, NULL);
     results->stats.duration = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
 
-    for (int i = 0; i < state->action_count; i++) {
-        results->nodes[i] = *root->children[i];
+    results->score = -INFINITY;
+    for (int a = 0; a < state->action_count; a++) {
+        float score = -1 * results->nodes[a].value / results->nodes[a].visits;
+
+        if (score >= results->score) {
+            results->score = score;
+            results->actioni = a;
+        }
     }
 
     if (options.save_tree) {
-        results->tree = root;
+        results->tree = contexts[0].root;
+        results->tree_hash = State_hash(state);
+        results->tree_lazy = MCTSOptions_lazy(&options);
     } else {
-        Node_free(root);
-        results->tree = NULL;
+        NodeArena_free(&results->arena);
+    }
+}
+
+/**
+ * moves the root of the results' saved tree down to the child for an
+ * action from the given state, which has to be the root's position, and
+ * frees the rest of the tree. The tree is dropped altogether if it isn't
+ * for the state.
+ */
+void MCTSResults_descend(struct MCTSResults* results,
+    const struct State* state,
+    uint16_t actioni)
+{
+    if (results->tree == NO_NODE) {
+        return;
+    }
+
+    struct Node* root = NodeArena_node(&results->arena, results->tree);
+    if (results->tree_hash != State_hash(state)
+        || actioni >= state->action_count
+        || root->children == NO_CHILDREN
+        || root->children_count != state->action_count) {
+        MCTSResults_free_tree(results);
+        return;
+    }
+
+    uint32_t nodei = root->children + actioni;
+    uint32_t linki = Node_linked(NodeArena_node(&results->arena, nodei));
+    if (linki != NO_CHILDREN) {
+        nodei = linki;
+    }
+
+    struct State after;
+    State_copy(state, &after);
+    State_act(&after, &state->actions[actioni]);
+
+    struct NodeArena arena;
+    NodeArena_init(&arena);
+    results->tree = NodeArena_copy_tree(&arena, &results->arena, nodei, after.action_count);
+    NodeArena_free(&results->arena);
+    NodeArena_move(&results->arena, &arena);
+    results->tree_hash = State_hash(&after);
+}
+
+void MCTSResults_free_tree(struct MCTSResults* results)
+{
+    if (results->tree != NO_NODE) {
+        NodeArena_free(&results->arena);
+        results->tree = NO_NODE;
     }
 }
@@ -1,12 +1,31 @@
 #ifndef MCTS_H
 #define MCTS_H
 
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "rng.h"
 #include "state.h"
 
 #define DEFAULT_ITERATIONS 50000
 #define DEFAULT_MAX_SIM_DEPTH 300
 #define DEFAULT_UCTC .4
 #define DEFAULT_SAVE_TREE false
+#define DEFAULT_REUSE_TREE false
+#define DEFAULT_THREADS 1
+#define DEFAULT_ROOT_PARALLEL false
+#define DEFAULT_GRAPH false
+#define DEFAULT_SOLVER true
+#define DEFAULT_SEED 0
+#define DEFAULT_PUCT false
+#define DEFAULT_PUCTC 1.0
+#define DEFAULT_WIDENING false
+#define DEFAULT_WIDENING_C 2.0
+#define DEFAULT_WIDENING_EXPONENT 0.5
+
+// Added to a node's visits and value while a thread is searching below
+// it, so other threads searching the same tree are steered elsewhere
+#define VIRTUAL_LOSS 1.0
 
 // #define DEFAULT_PLACE_BIAS .9
 #define DEFAULT_QUEEN_PIN_BIAS .9
@@ -26,24 +45,154 @@
 #define DEFAULT_CUT_POINT_DIFF_TERM 7
 #define DEFAULT_CUT_POINT_DIFF_TERM_VALUE 1.0
 
+#define DEFAULT_LIGHT_PLAYOUTS false
+#define DEFAULT_EVAL_DEPTH 0
+
+// The categories of actions the simulation policy picks from, in the
+// order their biases apply; any action at random comes last
+enum PolicyCategory {
+    POLICY_QUEEN_SIDESTEP = 0,
+    POLICY_QUEEN_AWAY_MOVE,
+    POLICY_QUEEN_PIN_MOVE,
+    POLICY_BEETLE_SEEK_MOVE,
+    POLICY_PIN_MOVE,
+    POLICY_QUEEN_ADJACENT_ACTION,
+    POLICY_UNPIN_MOVE,
+    POLICY_QUEEN_NEARBY_ACTION,
+    POLICY_BEETLE_MOVE,
+    POLICY_RANDOM,
+    NUM_POLICY_CATEGORIES
+};
+
+/* With the solver, a node's value is INFINITY once it's proven a win for
+ * the player to move, and -INFINITY once it's proven a loss. Those carry
+ * through sums and means, so UCT always picks a move to a proven loss,
+ * and never a move to a proven win while there are others.
+ *
+ * With more than one thread, visits, value and children are shared
+ * between threads: they're updated atomically, and a node is expanded by
+ * whichever thread sets its children first.
+ */
 struct Node {
-    bool expanded;
     unsigned int visits;
     float value;
+    // How many of the visits are virtual, from threads still below
+    unsigned int virtual_visits;
 
-    struct Node** children;
-    uint_fast16_t children_count;
+    // Index of the first child in the arena, or NO_CHILDREN if the node
+    // hasn't been expanded; siblings are contiguous. In graph search, if
+    // children_count is LINK, the node is an edge to a node elsewhere for
+    // the same position, and children is that node's index. With PUCT or
+    // progressive widening, nodes below the root are expanded lazily, a
+    // child at a time: they have LAZY set in children_count, and their
+    // children are in blocks (see Node_open).
+    uint32_t children;
+    uint16_t children_count;
 
-    uint16_t depth;
+    // Index of the node's action in its parent's actions
+    uint16_t action;
+
+    // Prior of the node's action, with PUCT or progressive widening. The
+    // node after a block of lazily expanded children has the action and
+    // prior of the first child of the next block, so that the next child
+    // to open is known before its block is.
+    float prior;
+};
+
+/* Nodes for a search are bump allocated from an arena, in chunks that
+ * never move, and refer to each other by 32-bit index. An expansion's
+ * children always go in one chunk, so they can be walked as an array,
+ * and the whole tree is released by freeing the chunks.
+ */
+#define NODE_CHUNK_BITS 16
+#define NODE_CHUNK_SIZE (1 << NODE_CHUNK_BITS)
+#define MAX_NODE_CHUNKS (UINT32_MAX >> NODE_CHUNK_BITS)
+#define NO_CHILDREN UINT32_MAX
+#define NO_NODE UINT32_MAX
+#define LINK UINT16_MAX
+#define LAZY 0x8000
+// Size of the first block of a lazily expanded node's children; each
+// block after it is twice the size of the one before
+#define LAZY_BLOCK_SIZE 4
+
+struct NodeArena {
+    // Room for MAX_NODE_CHUNKS, so that the list never moves while
+    // other threads are looking up nodes
+    struct Node** chunks;
+    uint32_t chunk_count;
+    // Index of the next free node
+    uint32_t size;
+    // Bytes malloced for the chunks
+    uint64_t bytes;
+    pthread_mutex_t lock;
 };
 
+static inline struct Node* NodeArena_node(const struct NodeArena* arena, uint32_t index)
+{
+    return &arena->chunks[index >> NODE_CHUNK_BITS][index & (NODE_CHUNK_SIZE - 1)];
+}
+
+/* For graph search, a hash table from positions to the nodes first
+ * reached for them. Entries are a node's index, with the top half of the
+ * position's hash above it; the bottom half picks the bucket. They're
+ * only ever added, so a lookup's answer never changes.
+ */
+#define NODE_TABLE_PROBES 32
+#define MIN_NODE_TABLE_BITS 16
+#define MAX_NODE_TABLE_BITS 26
+#define DEFAULT_NODE_TABLE_BITS 22
+
+struct NodeTable {
+    uint64_t* entries;
+    uint64_t mask;
+};
+
+// Deep enough that no playable line gets near it
+#define MAX_GRAPH_PATH 1024
+
 struct MCTSOptions {
     uint64_t iterations;
     uint64_t seconds;
     float uctc;
     uint16_t max_sim_depth;
+    // Seed for the search's random numbers; each thread's generator is
+    // seeded with it plus the thread's index, so a single-threaded search
+    // with the same seed and limit plays out the same
+    uint64_t seed;
     bool save_tree;
+    // Pick up from the tree saved in the results by an earlier search, if
+    // it's for the same position; the results' tree is freed otherwise
+    bool reuse_tree;
+    // Threads searching, each doing the given number of iterations. They
+    // share a single tree, unless root_parallel is set, in which case
+    // each searches a tree of its own and the roots' children are summed.
+    uint16_t threads;
+    bool root_parallel;
+    // Search a graph rather than a tree, with nodes for the same position
+    // shared between the lines that reach it
+    bool graph;
+    // Prove wins and losses through the tree (MCTS-Solver)
+    bool solver;
+    // Select children by PUCT rather than UCT, with priors from the prior
+    // function, which fills them in for a state's actions. Nodes below the
+    // root get a child at a time, in order of prior, as PUCT wants them.
+    bool puct;
+    float puctc;
+    void (*prior)(const struct State*, const struct MCTSOptions*, float priors[]);
+    // Progressive widening, for UCT: nodes below the root only have
+    // widening_c * visits^widening_exponent children to select from,
+    // opened in order of prior as their visits grow
+    bool widening;
+    float widening_c;
+    float widening_exponent;
 
+    // Simulations find only the actions of a piece picked at random (or
+    // the places) on most plies, rather than every action, and the policy
+    // picks from those
+    bool light_playouts;
+    // Simulations stop after this many plies, if it isn't 0, and are
+    // scored by the evaluator, as they are at the max depth
+    uint16_t eval_depth;
     float queen_sidestep_bias;
     float queen_away_move_bias;
     float queen_pin_move_bias;
@@ -68,6 +217,14 @@ struct MCTSStats {
     float mean_sim_depth;
     uint32_t cut_point_terminations;
     uint32_t depth_outs;
+    uint32_t eval_outs;
+    // Simulation plies that found only some of the actions
+    uint64_t light_plies;
+    // Simulation plies played by each category of the policy
+    uint64_t policy_picks[NUM_POLICY_CATEGORIES];
+    uint32_t transpositions;
+    // Root visits in a tree picked up from an earlier search
+    uint32_t reused_visits;
     uint64_t duration;
     uint32_t change_iterations;
 };
@@ -77,12 +234,55 @@ struct MCTSResults {
     float score;
     struct MCTSStats stats;
     struct Node nodes[MAX_ACTIONS];
-    struct Node* tree;
+    // The index of the search tree's root in the arena holding it, or
+    // NO_NODE if the tree isn't saved (the first thread's, with root
+    // parallelism), and the hash of the position at the root
+    uint32_t tree;
+    uint64_t tree_hash;
+    // Whether the nodes below the tree's root were expanded lazily, in
+    // which case only a PUCT search can pick up from it
+    bool tree_lazy;
+    struct NodeArena arena;
     const struct Action* presearch_action;
 };
 
+/* What each thread of a search works with, passed down through the search
+ * rather than kept in globals, so that any number of searches can run at
+ * once. With root parallelism, each thread has a tree of its own;
+ * otherwise they all share the first thread's.
+ */
+struct MCTSContext {
+    const struct MCTSOptions* options;
+    struct MCTSResults* results;
+    struct MCTSStats stats;
+    struct NodeArena* arena;
+    // The tree's node table, in graph search, or NULL
+    struct NodeTable* table;
+
+    bool first;
+    // Whether other threads are searching the same tree
+    bool shared;
+    const struct State* state;
+    uint32_t root;
+    struct timeval start;
+    struct Rng rng;
+    // Depth of the node being searched
+    uint16_t depth;
+
+    // In graph search, hashes of the positions above the current one
+    uint64_t path[MAX_GRAPH_PATH];
+    uint_fast16_t path_length;
+};
+
 void MCTSOptions_default(struct MCTSOptions*);
 
+void NodeArena_free(struct NodeArena* arena);
+
+void MCTSResults_descend(struct MCTSResults* results,
+    const struct State* state,
+    uint16_t actioni);
+void MCTSResults_free_tree(struct MCTSResults* results);
+
 void mcts(const struct State*, struct MCTSResults*, const struct MCTSOptions*);
 
 #endif
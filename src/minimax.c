@@ -3,40 +3,42 @@
 #include <math.h>
 #include <string.h>
 
+#include "evaluate.h"
 #include "state.h"
 
-static struct MinimaxOptions options;
-static struct MinimaxResults* results;
-
 void MinimaxOptions_default(struct MinimaxOptions* options)
 {
     options->depth = DEFAULT_MINIMAX_DEPTH;
 }
 
-float evaluate(const struct State* state)
+/**
+ * walks down and back up the tree with a single state; the action list
+ * is copied first, because State_unact leaves actions stale
+ */
+float search(struct State* state, int depth, struct MinimaxStats* stats)
 {
-    return 0.0;
-}
-
-float search(const struct State* state, int depth)
-{
-    results->stats.nodes++;
+    stats->nodes++;
 
-    if (state->winning_action) {
+    State_derive_actions(state);
+    if (state->winning_action != NO_ACTION) {
         return depth + 1;
     }
 
     if (depth == 0) {
-        results->stats.leaves++;
-        return evaluate(state);
+        stats->leaves++;
+        return State_evaluate(state);
     }
 
+    struct Action actions[MAX_ACTIONS];
+    uint_fast16_t action_count = state->action_count;
+    memcpy(actions, state->actions, sizeof(struct Action) * action_count);
+
     float best_score = -INFINITY;
-    for (int i = 0; i < state->action_count; i++) {
-        struct State child;
-        State_copy(state, &child);
-        State_act(&child, &state->actions[i]);
-        float child_score = -search(&child, depth - 1);
+    for (int i = 0; i < action_count; i++) {
+        struct Undo undo;
+        State_act_undoable(state, &actions[i], &undo);
+        float child_score = -search(state, depth - 1, stats);
+        State_unact(state, &undo);
         if (child_score >= best_score) {
             best_score = child_score;
         }
@@ -46,40 +48,43 @@ float search(const struct State* state, int depth)
 }
 
 void minimax(const struct State* state,
-    struct MinimaxResults* r,
+    struct MinimaxResults* results,
     const struct MinimaxOptions* o)
 {
+    struct MinimaxOptions options;
     if (o == NULL) {
         MinimaxOptions_default(&options);
     } else {
         options = *o;
     }
 
-    results = r;
     memset(results, 0, sizeof(struct MinimaxResults));
 
     results->stats.nodes++;
 
-    if (state->winning_action) {
-        results->action = *state->winning_action;
+    if (state->winning_action != NO_ACTION) {
+        results->action = state->actions[state->winning_action];
         results->score = INFINITY;
         results->stats.leaves++;
         return;
     }
 
     if (options.depth == 0) {
-        results->score = evaluate(state);
+        results->score = State_evaluate(state);
         results->stats.leaves++;
         return;
     }
 
+    struct State s;
+    State_copy(state, &s);
+
     results->score = -INFINITY;
     for (int i = 0; i < state->action_count; i++) {
-        struct State child;
-        State_copy(state, &child);
-        State_act(&child, &state->actions[i]);
+        struct Undo undo;
+        State_act_undoable(&s, &state->actions[i], &undo);
+        float child_score = -search(&s, options.depth - 1, &results->stats);
+        State_unact(&s, &undo);
 
-        float child_score = -search(&child, options.depth - 1);
         if (child_score > results->score) {
             results->score = child_score;
             results->action = state->actions[i];
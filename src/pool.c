@@ -0,0 +1,113 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+/* A call to pool_run, on the caller's stack. Tasks below next have been
+ * taken, and pending of them haven't returned yet.
+ */
+struct PoolJob {
+    void (*task)(void*, int);
+    void* arg;
+    int count;
+    int next;
+    int pending;
+    // Jobs with tasks left to take are queued, oldest first
+    struct PoolJob* queued;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_posted = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t task_done = PTHREAD_COND_INITIALIZER;
+static struct PoolJob* queue;
+static int size;
+// Threads that the jobs running at the moment could use between them
+static int wanted;
+
+/**
+ * takes the job's next task, dequeuing the job if it was the last, and
+ * runs it; called and returns with lock held
+ */
+void PoolJob_work(struct PoolJob* job)
+{
+    int i = job->next++;
+    if (job->next == job->count) {
+        struct PoolJob** j = &queue;
+        while (*j != job) {
+            j = &(*j)->queued;
+        }
+        *j = job->queued;
+    }
+
+    pthread_mutex_unlock(&lock);
+    job->task(job->arg, i);
+    pthread_mutex_lock(&lock);
+
+    if (--job->pending == 0) {
+        pthread_cond_broadcast(&task_done);
+    }
+}
+
+void* pool_thread(void* arg)
+{
+    pthread_mutex_lock(&lock);
+    while (1) {
+        while (queue == NULL) {
+            pthread_cond_wait(&job_posted, &lock);
+        }
+        PoolJob_work(queue);
+    }
+
+    return NULL;
+}
+
+void pool_run(int count, void (*task)(void* arg, int i), void* arg)
+{
+    if (count <= 1) {
+        if (count == 1) {
+            task(arg, 0);
+        }
+        return;
+    }
+
+    struct PoolJob job = {
+        .task = task,
+        .arg = arg,
+        .count = count,
+        .next = 0,
+        .pending = count,
+        .queued = NULL,
+    };
+
+    pthread_mutex_lock(&lock);
+
+    wanted += count - 1;
+    for (; size < wanted; size++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, pool_thread, NULL)) {
+            fprintf(stderr, "ERROR: failure to start pool thread\n");
+            exit(1);
+        }
+        pthread_detach(thread);
+    }
+
+    struct PoolJob** j = &queue;
+    while (*j) {
+        j = &(*j)->queued;
+    }
+    *j = &job;
+    pthread_cond_broadcast(&job_posted);
+
+    // The caller works on its own job too, so that it's never left waiting
+    // on threads busy with others
+    while (job.next < job.count) {
+        PoolJob_work(&job);
+    }
+    while (job.pending) {
+        pthread_cond_wait(&task_done, &lock);
+    }
+    wanted -= count - 1;
+
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,14 @@
+#ifndef POOL_H
+#define POOL_H
+
+/* A pool of threads kept between searches, so that a parallel search
+ * doesn't pay for starting and joining threads every move.
+ */
+
+// Calls task(arg, i) for each i below count, spread over the calling
+// thread and the pool's, and returns once all of them have returned. The
+// pool grows as needed to give each caller count - 1 threads, and any
+// number of threads can call at once.
+void pool_run(int count, void (*task)(void* arg, int i), void* arg);
+
+#endif
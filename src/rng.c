@@ -0,0 +1,21 @@
+#include "rng.h"
+
+// splitmix64, see https://prng.di.unimi.it/splitmix64.c
+uint64_t splitmix64(uint64_t* x)
+{
+    uint64_t z = (*x += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+/**
+ * seeds a generator, filling in its state from splitmix64 as the authors
+ * of xoshiro recommend, so that any seed, even 0, gives a good state
+ */
+void Rng_seed(struct Rng* rng, uint64_t seed)
+{
+    for (int i = 0; i < 4; i++) {
+        rng->s[i] = splitmix64(&seed);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/* A small, fast pseudorandom number generator (xoshiro256**, see
+ * https://prng.di.unimi.it/), for anything that needs to be reproducible
+ * from a seed. Unlike rand(), there's no hidden global state or lock:
+ * each search thread has a generator of its own.
+ */
+struct Rng {
+    uint64_t s[4];
+};
+
+uint64_t splitmix64(uint64_t* x);
+
+void Rng_seed(struct Rng* rng, uint64_t seed);
+
+static inline uint64_t rotl64(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t Rng_next(struct Rng* rng)
+{
+    uint64_t* s = rng->s;
+    uint64_t result = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+
+    return result;
+}
+
+// Returns a number below bound, without modulo bias (Lemire's method:
+// the high half of a 32-by-32 bit product, retried in the rare case the
+// low half says it's in the uneven part of the range)
+static inline uint32_t Rng_below(struct Rng* rng, uint32_t bound)
+{
+    uint64_t m = (Rng_next(rng) >> 32) * bound;
+    if ((uint32_t)m < bound) {
+        uint32_t threshold = -bound % bound;
+        while ((uint32_t)m < threshold) {
+            m = (Rng_next(rng) >> 32) * bound;
+        }
+    }
+    return m >> 32;
+}
+
+// Returns a float in [0, 1), from the top 24 bits
+static inline float Rng_unit(struct Rng* rng)
+{
+    return (Rng_next(rng) >> 40) * 0x1.0p-24f;
+}
+
+#endif
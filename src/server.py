@@ -55,7 +55,11 @@ async def state_actions(state: str = Path(regex=STATE_REGEX)) -> ActionsResponse
 
 @app.get("/state/{state}/think", response_model=ThinkResponse)
 async def state_think(state: str = Path(regex=STATE_REGEX)) -> ThinkResponse:
-    action, stderr = zoe(f"-t", "-w", str(WORKERS), "-i", str(ITERATIONS), state)
+    # Workers search trees of their own (-R), as they did as processes, which
+    # is what the iteration counts here were tuned for
+    action, stderr = zoe(
+        f"-t", "-w", str(WORKERS), "-R", "-i", str(ITERATIONS), state
+    )
     new_state, _ = zoe("-a", action, state)
     actions, _ = get_actions(new_state)
     action_states = {
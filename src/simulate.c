@@ -1,6 +1,8 @@
 #include <stdlib.h>
 
+#include "evaluate.h"
 #include "mcts.h"
+#include "rng.h"
 #include "state.h"
 
 #ifdef WATCH_SIMS
@@ -8,262 +10,532 @@
 #include <stdio.h>
 #endif
 
-int State_beetle_seek_path(
-    const struct State* state,
-    const struct Piece* piece,
-    struct Coords* path)
+bool State_is_queen_sidestep(const struct State* state, const struct Action* action)
 {
-    if (!state->queens[!piece->player]) {
-        return -1;
-    }
-    struct Coords target = state->queens[!piece->player]->coords;
+    return state->neighbor_count[!state->turn][action->to.q][action->to.r] == 1
+        && state->neighbor_count[state->turn][action->to.q][action->to.r] == 1
+        // Not a sidestep if we're already in a similar position
+        && State_hex_neighbor_count(state, &action->from) > 1;
+}
 
-    struct Coords queue[MAX_PIECES];
-    unsigned int queue_size = 0;
-    queue[queue_size++] = piece->coords;
+/**
+ * spreads a bias's share of the probability left over a category of
+ * actions, as a simulation picks one of them if the bias says to
+ */
+void spread_prior(float priors[], const uint16_t* actions, int count, float bias, float* left)
+{
+    if (!count) {
+        return;
+    }
 
-    struct Coords crumbs[GRID_SIZE][GRID_SIZE];
-    for (int q = 0; q < GRID_SIZE; q++) {
-        for (int r = 0; r < GRID_SIZE; r++) {
-            crumbs[q][r].q = GRID_SIZE + 1;
-        }
+    float share = *left * bias;
+    for (int i = 0; i < count; i++) {
+        priors[actions[i]] += share / count;
     }
+    *left -= share;
+}
 
-    struct Coords coords;
-    bool found = false;
-    while (queue_size) {
-        coords = queue[--queue_size];
+/**
+ * fills in, for each of a state's actions, the chance that a simulation
+ * picks it, going through the same categories with the same biases. The
+ * beetle seek bias is left out, as it depends on which beetle a
+ * simulation picks.
+ */
+void State_policy_priors(const struct State* state, const struct MCTSOptions* options, float priors[])
+{
+    for (int i = 0; i < state->action_count; i++) {
+        priors[i] = 0.0;
+    }
+    float left = 1.0;
 
-        if (coords.q == target.q && coords.r == target.r) {
-            found = true;
-            break;
+    uint16_t sidesteps[MAX_QUEEN_MOVES];
+    int sidestep_count = 0;
+    for (int i = 0; i < state->queen_move_count; i++) {
+        if (State_is_queen_sidestep(state, &state->actions[state->queen_moves[i]])) {
+            sidesteps[sidestep_count++] = state->queen_moves[i];
         }
+    }
 
-        for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
-            struct Coords neighbor = coords;
-            Coords_move(&neighbor, d);
-
-            if (piece->coords.q == neighbor.q && piece->coords.r == neighbor.r) {
-                continue;
-            }
+    spread_prior(priors, sidesteps, sidestep_count, options->queen_sidestep_bias, &left);
+    spread_prior(priors, state->queen_away_moves, state->queen_away_move_count, options->queen_away_move_bias, &left);
+    spread_prior(priors, state->queen_pin_moves, state->queen_pin_move_count, options->queen_pin_move_bias, &left);
+    spread_prior(priors, state->pin_moves, state->pin_move_count, options->pin_move_bias, &left);
+    spread_prior(priors, state->queen_adjacent_actions, state->queen_adjacent_action_count, options->queen_adjacent_action_bias, &left);
+    spread_prior(priors, state->unpin_moves, state->unpin_move_count, options->unpin_move_bias, &left);
+    spread_prior(priors, state->queen_nearby_actions, state->queen_nearby_action_count, options->queen_nearby_action_bias, &left);
+    spread_prior(priors, state->beetle_moves, state->beetle_move_count, options->beetle_move_bias, &left);
+
+    for (int i = 0; i < state->action_count; i++) {
+        priors[i] += left / state->action_count;
+    }
+}
 
-            if (!state->grid[neighbor.q][neighbor.r]) {
-                continue;
-            }
+const char* POLICY_CATEGORY_NAMES[NUM_POLICY_CATEGORIES] = {
+    "queen sidestep",
+    "queen away move",
+    "queen pin move",
+    "beetle seek move",
+    "pin move",
+    "queen adjacent action",
+    "unpin move",
+    "queen nearby action",
+    "beetle move",
+    "random",
+};
 
-            if (crumbs[neighbor.q][neighbor.r].q != GRID_SIZE + 1) {
-                continue;
-            }
-            crumbs[neighbor.q][neighbor.r] = coords;
-            queue[queue_size++] = neighbor;
-        }
+/**
+ * returns a beetle's move a step closer to the enemy queen over the hive,
+ * or NULL if it has none (including when it's already next to the queen)
+ */
+const struct Action* State_beetle_seek_move(struct State* state, const struct Piece* beetle)
+{
+    if (!state->queens[!state->turn]) {
+        return NULL;
     }
 
-    if (!found) {
-        return -1;
+    // A beetle on or next to the queen is as close as it gets
+    const struct Coords* queen = &State_piece(state, state->queens[!state->turn])->coords;
+    if ((beetle->coords.q == queen->q && beetle->coords.r == queen->r)
+        || Coords_adjacent(&beetle->coords, queen)) {
+        return NULL;
     }
 
-    int path_size = 0;
-    while (coords.q != piece->coords.q && coords.r != piece->coords.r) {
-        path[path_size++] = coords;
-        coords = crumbs[coords.q][coords.r];
+    for (int i = 0; i < state->beetle_move_count; i++) {
+        const struct Action* beetle_move = &state->actions[state->beetle_moves[i]];
+        if (beetle_move->from.q != beetle->coords.q
+            || beetle_move->from.r != beetle->coords.r
+            || !state->grid[beetle_move->to.q][beetle_move->to.r]) {
+            continue;
+        }
+
+        // Distances are only worth deriving once the beetle has a move
+        // onto the hive
+        State_derive_queen_distances(state);
+        int distance = state->queen_distances[Coords_cell(&beetle->coords)];
+        if (state->queen_distances[Coords_cell(&beetle_move->to)] == distance - 1) {
+            return beetle_move;
+        }
     }
 
-    return path_size;
+    return NULL;
 }
 
-bool State_cut_point_neighbor(
-    const struct State* state,
-    const struct Coords* coords);
+/* The simulation policy for a ply, as a table of the categories of
+ * actions it picks from, in the order their biases apply: a category is
+ * picked from with its bias's chance if none before it has been, and
+ * whatever chance is left goes to picking any action at random. An action
+ * picked is then passed on by chance (see Policy_add_passes), and
+ * another picked in its place, which comes to weighting each action by
+ * its chance of being kept.
+ *
+ * Moves from next to the enemy queen are passed on most of the time, and
+ * picking any action at random, where most of them would be picked, is
+ * weighted by the share of actions that aren't, so a pick of one there
+ * is made up for within the category. Other passes are rare enough to
+ * be made up for by picking again: on actions that pin one of the
+ * player's own pieces, which are only told apart once picked, and on
+ * the other categories' actions, as the categories are weighted as if
+ * every action in them were kept. The beetle seek category is weighted
+ * the same way, as if every beetle had a move, as a beetle's move is
+ * only worth finding once it's picked.
+ */
+struct PolicyEntry {
+    enum PolicyCategory category;
+    // The category's actions, or NULL for all of them (or the player's
+    // beetles, for the beetle seek category)
+    const uint16_t* actions;
+    int count;
+    // Weight of this category and the ones before it
+    float cumulative;
+};
+
+struct Policy {
+    struct PolicyEntry entries[NUM_POLICY_CATEGORIES];
+    int entry_count;
+    float total;
+    // Where the beetle seek category is in the table, or -1, and the
+    // chances that the categories after it would have had without it,
+    // for picking from them when a beetle has no move to seek with
+    int seek_entry;
+    float unsought;
+    // Whether any action might be passed on, the chances of keeping
+    // actions that pin one of the player's own pieces and moves from next
+    // to the enemy queen, the enemy queen if the player has moves from
+    // next to it, and the sum of those moves' chances of being passed on
+    bool passing;
+    float own_pin_keep;
+    float from_queen_keep;
+    const struct Coords* from_queen;
+    float from_queen_passed;
+    uint16_t sidesteps[MAX_QUEEN_MOVES];
+};
+
+static inline bool Policy_from_queen(const struct Policy* policy, const struct Action* action)
+{
+    return policy->from_queen && Coords_adjacent(&action->from, policy->from_queen);
+}
 
-bool State_is_queen_sidestep(const struct State* state, const struct Action* action)
+/**
+ * rolls whether the simulation keeps an action it's picked, rather than
+ * passing on it to pick again, leaving out the pass on a move from next
+ * to the enemy queen if the pick was weighted for it already
+ */
+static inline bool Policy_kept(const struct Policy* policy,
+    const struct State* state,
+    const struct Action* action,
+    bool from_queen_weighted,
+    struct Rng* rng)
 {
-    return state->neighbor_count[!state->turn][action->to.q][action->to.r] == 1
-        && state->neighbor_count[state->turn][action->to.q][action->to.r] == 1
-        // Not a sidestep if we're already in a similar position
-        && State_hex_neighbor_count(state, &action->from) > 1;
+    if (!policy->passing) {
+        return true;
+    }
+
+    float keep = 1.0;
+    if (!from_queen_weighted && Policy_from_queen(policy, action)) {
+        keep *= policy->from_queen_keep;
+    }
+    if (policy->own_pin_keep != 1.0 && State_own_pin_hex(state, &action->to)) {
+        keep *= policy->own_pin_keep;
+    }
+    return keep == 1.0 || Rng_unit(rng) < keep;
 }
 
 /**
- * simulates play (in place) on a state, stopping at game end or
- * MAX_SIM_DEPTH, and returns 1.0 if the initial turn won, -1.0 if it
- * lost, and 0.0 on a draw or depth out
+ * notes the chances that the simulation passes on actions if they're
+ * picked: actions that pin one of the player's own pieces, and moves
+ * from next to the enemy queen, which are counted. Every other action is
+ * kept for sure.
  */
-float State_simulate(struct State* state,
-    const struct MCTSOptions* options, struct MCTSStats* stats)
+void Policy_add_passes(struct Policy* policy, const struct State* state, const struct MCTSOptions* options)
 {
-    stats->simulations++;
+    policy->passing = true;
+    policy->own_pin_keep = 1.0 - options->own_pin_pass;
+    policy->from_queen_keep = 1.0 - options->from_queen_pass;
 
-    enum Player original_turn = state->turn;
-    int original_cut_point_diff = state->cut_point_count[!original_turn] - state->cut_point_count[original_turn];
+    if (!options->from_queen_pass || !state->queens[!state->turn]) {
+        return;
+    }
 
-    int depth = 0;
-    while (state->result == NO_RESULT) {
-        if (state->winning_action) {
-            State_act(state, state->winning_action);
+    // Moves from next to the enemy queen are the moves of the player's
+    // pieces on top there
+    const struct Coords* queen = &State_piece(state, state->queens[!state->turn])->coords;
+    int move_count = 0;
+    for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+        uint8_t id = state->cells[Cell_move(Coords_cell(queen), d)];
+        if (!id) {
             continue;
         }
-
-        int cut_point_diff = state->cut_point_count[!original_turn] - state->cut_point_count[original_turn];
-        int cut_point_diff_change = cut_point_diff - original_cut_point_diff;
-        if (cut_point_diff_change >= options->cut_point_diff_terminate) {
-            stats->cut_point_terminations++;
-            // TODO correct sign?
-            return -DEFAULT_CUT_POINT_DIFF_TERM_VALUE;
-        } else if (cut_point_diff_change <= -options->cut_point_diff_terminate) {
-            stats->cut_point_terminations++;
-            // TODO correct sign?
-            return DEFAULT_CUT_POINT_DIFF_TERM_VALUE;
+        while (State_piece(state, id)->on_top) {
+            id = State_piece(state, id)->on_top;
+        }
+        if (State_piece(state, id)->player != state->turn) {
+            continue;
         }
 
-        if (depth++ > options->max_sim_depth) {
-            stats->depth_outs++;
-            return 0.0;
+        move_count += state->piece_move_count[(id - 1) % PLAYER_PIECES];
+    }
+
+    if (move_count) {
+        policy->from_queen = queen;
+        policy->from_queen_passed = move_count * options->from_queen_pass;
+    }
+}
+
+/**
+ * adds a category to the policy, if it has actions to pick from, given
+ * the chance left to go to it and the categories after it
+ */
+void Policy_add(struct Policy* policy,
+    enum PolicyCategory category,
+    const uint16_t* actions,
+    int count,
+    float bias,
+    float* left)
+{
+    if (!count || !bias) {
+        return;
+    }
+
+    if (policy->seek_entry >= 0) {
+        policy->unsought += *left * bias;
+    } else if (category == POLICY_BEETLE_SEEK_MOVE) {
+        policy->seek_entry = policy->entry_count;
+    }
+
+    float weight = *left * bias;
+    if (category == POLICY_RANDOM && policy->from_queen) {
+        weight *= (count - policy->from_queen_passed) / count;
+    }
+    if (weight > 0) {
+        policy->total += weight;
+        policy->entries[policy->entry_count++] = (struct PolicyEntry) {
+            .category = category,
+            .actions = actions,
+            .count = count,
+            .cumulative = policy->total,
+        };
+    }
+    *left *= 1.0 - bias;
+}
+
+void Policy_build(struct Policy* policy, const struct State* state, const struct MCTSOptions* options)
+{
+    policy->entry_count = 0;
+    policy->total = 0.0;
+    policy->seek_entry = -1;
+    policy->unsought = 0.0;
+    float left = 1.0;
+
+    policy->passing = false;
+    policy->from_queen = NULL;
+    if (options->own_pin_pass || options->from_queen_pass) {
+        Policy_add_passes(policy, state, options);
+    }
+
+    int sidestep_count = 0;
+    if (options->queen_sidestep_bias) {
+        for (int i = 0; i < state->queen_move_count; i++) {
+            if (State_is_queen_sidestep(state, &state->actions[state->queen_moves[i]])) {
+                policy->sidesteps[sidestep_count++] = state->queen_moves[i];
+            }
         }
+    }
+
+    Policy_add(policy, POLICY_QUEEN_SIDESTEP, policy->sidesteps, sidestep_count, options->queen_sidestep_bias, &left);
+    Policy_add(policy, POLICY_QUEEN_AWAY_MOVE, state->queen_away_moves, state->queen_away_move_count, options->queen_away_move_bias, &left);
+    Policy_add(policy, POLICY_QUEEN_PIN_MOVE, state->queen_pin_moves, state->queen_pin_move_count, options->queen_pin_move_bias, &left);
+    Policy_add(policy, POLICY_BEETLE_SEEK_MOVE, NULL, state->beetle_move_count ? state->beetle_count[state->turn] : 0, options->beetle_seek_move_bias, &left);
+    Policy_add(policy, POLICY_PIN_MOVE, state->pin_moves, state->pin_move_count, options->pin_move_bias, &left);
+    Policy_add(policy, POLICY_QUEEN_ADJACENT_ACTION, state->queen_adjacent_actions, state->queen_adjacent_action_count, options->queen_adjacent_action_bias, &left);
+    Policy_add(policy, POLICY_UNPIN_MOVE, state->unpin_moves, state->unpin_move_count, options->unpin_move_bias, &left);
+    Policy_add(policy, POLICY_QUEEN_NEARBY_ACTION, state->queen_nearby_actions, state->queen_nearby_action_count, options->queen_nearby_action_bias, &left);
+    Policy_add(policy, POLICY_BEETLE_MOVE, state->beetle_moves, state->beetle_move_count, options->beetle_move_bias, &left);
+    Policy_add(policy, POLICY_RANDOM, NULL, state->action_count, 1.0, &left);
+}
 
-    select_action : {
+/**
+ * picks an action by the policy, and gives the category it came from
+ */
+const struct Action* Policy_pick(const struct Policy* policy,
+    struct State* state,
+    struct Rng* rng,
+    enum PolicyCategory* category)
+{
+    // The random category covers every action, so it's only left out if
+    // every action is a move from next to the enemy queen that's passed
+    // on for sure
+    if (!policy->entry_count || policy->entries[policy->entry_count - 1].category != POLICY_RANDOM) {
+        *category = POLICY_RANDOM;
+        return &state->actions[Rng_below(rng, state->action_count)];
+    }
 
-        struct Action* action = NULL;
+    for (;;) {
+        float draw = Rng_unit(rng) * policy->total;
+        int i = 0;
+        while (i < policy->entry_count && draw >= policy->entries[i].cumulative) {
+            i++;
+        }
 
-        if (options->queen_sidestep_bias && state->queen_move_count) {
-            struct Action* actions[MAX_QUEEN_MOVES];
-            int action_count = 0;
-            for (int i = 0; i < state->queen_move_count; i++) {
-                struct Action* action = state->queen_moves[i];
-                if (State_is_queen_sidestep(state, action)) {
-                    actions[action_count++] = action;
+        if (i == policy->seek_entry) {
+            const struct PolicyEntry* seek = &policy->entries[i];
+            const struct Action* action = State_beetle_seek_move(state,
+                State_piece(state, state->beetles[state->turn][Rng_below(rng, seek->count)]));
+            if (action) {
+                if (Policy_kept(policy, state, action, false, rng)) {
+                    *category = POLICY_BEETLE_SEEK_MOVE;
+                    return action;
                 }
+                continue;
             }
 
-            if (action_count
-                && (rand() / (float)RAND_MAX) < options->queen_sidestep_bias) {
-                action = actions[rand() % action_count];
-#ifdef WATCH_SIMS
-                printf("queen sidestep\n");
-#endif
-                goto action_selected;
+            // A beetle with no move to seek with leaves the categories
+            // after it to pick from, as if the seek bias were 0, by the
+            // share of their chances that's kept
+            float rest = policy->total - seek->cumulative;
+            if (Rng_unit(rng) * policy->unsought >= rest) {
+                continue;
+            }
+            draw = seek->cumulative + Rng_unit(rng) * rest;
+            while (i < policy->entry_count && draw >= policy->entries[i].cumulative) {
+                i++;
             }
         }
 
-        if (state->queen_away_move_count
-            && (rand() / (float)RAND_MAX) < options->queen_away_move_bias) {
-            action = state->queen_away_moves[rand() % state->queen_away_move_count];
-#ifdef WATCH_SIMS
-            printf("queen away move\n");
-#endif
-            goto action_selected;
+        // Rounding can leave the draw past the last category
+        if (i == policy->entry_count) {
+            continue;
         }
 
-        if (state->queen_pin_move_count
-            && (rand() / (float)RAND_MAX) < options->queen_pin_move_bias) {
-            action = state->queen_pin_moves[rand() % state->queen_pin_move_count];
-#ifdef WATCH_SIMS
-            printf("queen pin move\n");
-#endif
-            goto action_selected;
+        const struct PolicyEntry* entry = &policy->entries[i];
+        if (entry->actions) {
+            const struct Action* action = &state->actions[entry->actions[Rng_below(rng, entry->count)]];
+            if (Policy_kept(policy, state, action, false, rng)) {
+                *category = entry->category;
+                return action;
+            }
+            continue;
         }
 
-        if (state->beetle_move_count
-            && (rand() / (float)RAND_MAX) < options->beetle_seek_move_bias) {
-            struct Piece* beetle = state->beetles[state->turn][rand() % state->beetle_count[state->turn]];
-            struct Coords path[MAX_PIECES];
-            int path_size = State_beetle_seek_path(state, beetle, path);
+        const struct Action* action;
+        do {
+            action = &state->actions[Rng_below(rng, entry->count)];
+        } while (Policy_from_queen(policy, action) && Rng_unit(rng) >= policy->from_queen_keep);
+        if (Policy_kept(policy, state, action, true, rng)) {
+            *category = POLICY_RANDOM;
+            return action;
+        }
+    }
+}
 
-            if (path_size > 1) {
-                for (int i = 0; i < state->beetle_move_count; i++) {
-                    if (state->beetle_moves[i]->to.q == path[path_size - 1].q
-                        && state->beetle_moves[i]->to.r == path[path_size - 1].r) {
+/**
+ * finds only some of a state's actions, for a light simulation ply: a
+ * piece is picked at random from the player's (or the places are, as if
+ * they were another piece) until one has actions, and its actions are
+ * sorted into the policy's categories as usual. Returns false, finding
+ * nothing, if the actions have to be found in full: when they're already
+ * up to date, in the opening, and when either queen is one piece from
+ * being surrounded, as the winning action and the moves away from the
+ * player's queen could be any piece's.
+ */
+bool State_derive_light_actions(struct State* state, struct Rng* rng)
+{
+    if (state->actions_derived || !state->piece_count[P1] || !state->piece_count[P2]) {
+        return false;
+    }
+    for (enum Player p = 0; p < NUM_PLAYERS; p++) {
+        if (state->queens[p]
+            && State_hex_neighbor_count(state, &State_piece(state, state->queens[p])->coords) == NUM_DIRECTIONS - 1) {
+            return false;
+        }
+    }
 
-                        action = state->beetle_moves[i];
-#ifdef WATCH_SIMS
-                        printf("beetle seek move\n");
-#endif
-                        goto action_selected;
-                    }
-                }
+    if (!state->cut_points_derived) {
+        State_derive_cut_points(state);
+    }
+    State_start_actions(state);
+
+    // Indices of the pieces that might move, and -1 for the places
+    int movers[PLAYER_PIECES + 1];
+    int mover_count = 0;
+    // A player can't move until their queen is placed
+    if (!state->hands[state->turn][QUEEN_BEE]) {
+        for (int i = 0; i < state->piece_count[state->turn]; i++) {
+            if (!state->pieces[state->turn][i].on_top) {
+                movers[mover_count++] = i;
             }
         }
+    }
+    if (state->piece_count[state->turn] < PLAYER_PIECES) {
+        movers[mover_count++] = -1;
+    }
 
-        if (state->pin_move_count
-            && (rand() / (float)RAND_MAX) < options->pin_move_bias) {
-            action = state->pin_moves[rand() % state->pin_move_count];
-#ifdef WATCH_SIMS
-            printf("pin move\n");
-#endif
-            goto action_selected;
+    bool perimeter_derived = false;
+    while (mover_count && !state->action_count) {
+        int moveri = Rng_below(rng, mover_count);
+        int piecei = movers[moveri];
+        movers[moveri] = movers[--mover_count];
+
+        if (piecei < 0) {
+            State_add_places(state);
+            continue;
         }
 
-        // TODO only do this if the queen is pinned?
-        if (state->queen_adjacent_action_count
-            && (rand() / (float)RAND_MAX) < options->queen_adjacent_action_bias) {
-            action = state->queen_adjacent_actions[rand() % state->queen_adjacent_action_count];
-#ifdef WATCH_SIMS
-            printf("queen adjacent action\n");
-#endif
-            goto action_selected;
+        if (state->pieces[state->turn][piecei].type == ANT && !perimeter_derived) {
+            State_derive_perimeter(state);
+            perimeter_derived = true;
         }
+        State_derive_piece_moves(state, piecei);
+    }
 
-        if (state->unpin_move_count
-            && (rand() / (float)RAND_MAX) < options->unpin_move_bias) {
-            action = state->unpin_moves[rand() % state->unpin_move_count];
-#ifdef WATCH_SIMS
-            printf("unpin move\n");
-#endif
-            goto action_selected;
+    if (state->action_count == 0) {
+        state->actions[0].from.q = PASS_ACTION;
+        state->action_count = 1;
+    }
+
+    // The lists are partial, so anything else reading actions has to
+    // find them in full
+    state->actions_derived = false;
+    return true;
+}
+
+/**
+ * simulates play on a state, stopping at game end, the eval depth or
+ * MAX_SIM_DEPTH, and returns 1.0 if the initial turn won, -1.0 if it
+ * lost, 0.0 on a draw, and the evaluator's score if it stopped short
+ *
+ * play is undone with State_unact before returning, so the state's core
+ * information is unchanged, but its cut points and actions are stale
+ */
+float State_simulate(struct State* state, struct MCTSContext* context)
+{
+    const struct MCTSOptions* options = context->options;
+    struct MCTSStats* stats = &context->stats;
+    struct Rng* rng = &context->rng;
+
+    stats->simulations++;
+
+    enum Player original_turn = state->turn;
+    int original_cut_point_diff = state->cut_point_count[!original_turn] - state->cut_point_count[original_turn];
+
+    // Every ply is recorded so the simulation can be unwound; a winning
+    // action at the end doesn't count towards depth
+    struct Undo undos[options->max_sim_depth + 2];
+    int undo_count = 0;
+    float score;
+
+    int depth = 0;
+    while (state->result == NO_RESULT) {
+        if (options->light_playouts && State_derive_light_actions(state, rng)) {
+            stats->light_plies++;
+        } else {
+            State_derive_actions(state);
         }
 
-        if (state->queen_nearby_action_count
-            && (rand() / (float)RAND_MAX) < options->queen_nearby_action_bias) {
-            action = state->queen_nearby_actions[rand() % state->queen_nearby_action_count];
-#ifdef WATCH_SIMS
-            printf("queen nearby action\n");
-#endif
-            goto action_selected;
+        if (state->winning_action != NO_ACTION) {
+            State_act_undoable(state, &state->actions[state->winning_action], &undos[undo_count++]);
+            continue;
         }
 
-        if (state->beetle_move_count
-            && (rand() / (float)RAND_MAX) < options->beetle_move_bias) {
-            action = state->beetle_moves[rand() % state->beetle_move_count];
-#ifdef WATCH_SIMS
-            printf("beetle move\n");
-#endif
-            goto action_selected;
+        int cut_point_diff = state->cut_point_count[!original_turn] - state->cut_point_count[original_turn];
+        int cut_point_diff_change = cut_point_diff - original_cut_point_diff;
+        if (cut_point_diff_change >= options->cut_point_diff_terminate) {
+            stats->cut_point_terminations++;
+            // TODO correct sign?
+            score = -DEFAULT_CUT_POINT_DIFF_TERM_VALUE;
+            goto unwind;
+        } else if (cut_point_diff_change <= -options->cut_point_diff_terminate) {
+            stats->cut_point_terminations++;
+            // TODO correct sign?
+            score = DEFAULT_CUT_POINT_DIFF_TERM_VALUE;
+            goto unwind;
         }
 
-#ifdef WATCH_SIMS
-        printf("random\n");
-#endif
-        action = &state->actions[rand() % state->action_count];
+        // Play that goes on too long is cut off and scored by the
+        // evaluator, which scores for the player to move
+        if (options->eval_depth && depth >= options->eval_depth) {
+            stats->eval_outs++;
+            score = state->turn == original_turn ? State_evaluate(state) : -State_evaluate(state);
+            goto unwind;
+        }
+        if (depth++ > options->max_sim_depth) {
+            stats->depth_outs++;
+            score = state->turn == original_turn ? State_evaluate(state) : -State_evaluate(state);
+            goto unwind;
+        }
 
-    action_selected:
-#ifdef WATCH_SIMS
-        Action_print(action, stderr);
-#endif
+        struct Policy policy;
+        Policy_build(&policy, state, options);
 
-        if (action->from.q != PLACE_ACTION
-            && action->from.q != PASS_ACTION
-            && state->queens[!state->turn]
-            && Coords_adjacent(&action->from, &state->queens[!state->turn]->coords)
-            && (rand() / (float)RAND_MAX) < options->from_queen_pass) {
-#ifdef WATCH_SIMS
-            printf("from queen pass\n");
-#endif
-            goto select_action;
-        }
+        enum PolicyCategory category;
+        const struct Action* action = Policy_pick(&policy, state, rng, &category);
+        stats->policy_picks[category]++;
 
-        if (state->neighbor_count[state->turn][action->to.q][action->to.r] == 1
-            && state->neighbor_count[!state->turn][action->to.q][action->to.r] == 0
-            && !State_cut_point_neighbor(state, &action->to)
-            // Make sure this isn't a beetle-on-hive move
-            && !state->grid[action->to.q][action->to.r]
-            && (rand() / (float)RAND_MAX) < options->own_pin_pass) {
 #ifdef WATCH_SIMS
-            printf("own pin pass\n");
+        printf("%s\n", POLICY_CATEGORY_NAMES[category]);
+        Action_print(action, stderr);
 #endif
-            goto select_action;
-        }
 
-        State_act(state, action);
+        State_act_undoable(state, action, &undos[undo_count++]);
 
 #ifdef WATCH_SIMS
         State_print(state, stderr);
@@ -273,18 +545,22 @@ float State_simulate(struct State* state,
         getchar();
 #endif
     }
-    }
 
     stats->mean_sim_depth += (depth - stats->mean_sim_depth) / stats->simulations;
 
     if (state->result == DRAW) {
-        return 0.0;
+        score = 0.0;
+    } else if ((state->result == P1_WIN && original_turn == P1)
+        || (state->result == P2_WIN && original_turn == P2)) {
+        score = 1.0;
+    } else {
+        score = -1.0;
     }
 
-    if ((state->result == P1_WIN && original_turn == P1)
-        || (state->result == P2_WIN && original_turn == P2)) {
-        return 1.0;
+unwind:
+    while (undo_count) {
+        State_unact(state, &undos[--undo_count]);
     }
 
-    return -1.0;
+    return score;
 }
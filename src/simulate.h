@@ -4,10 +4,15 @@
 #include "mcts.h"
 #include "state.h"
 
-float State_simulate(struct State* state,
-    const struct MCTSOptions* options, struct MCTSStats* stats);
+extern const char* POLICY_CATEGORY_NAMES[NUM_POLICY_CATEGORIES];
+
+float State_simulate(struct State* state, struct MCTSContext* context);
 
 bool State_is_queen_sidestep(const struct State* state,
     const struct Action* action);
 
+void State_policy_priors(const struct State* state,
+    const struct MCTSOptions* options,
+    float priors[]);
+
 #endif
@@ -3,6 +3,8 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "rng.h"
+
 #ifdef CHECK_ACTIONS
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,7 +37,7 @@ struct Piece* State_neighbor_piece(
         c = *coords;
         Coords_move(&c, d);
         if (state->grid[c.q][c.r]) {
-            return state->grid[c.q][c.r];
+            return State_piece(state, state->grid[c.q][c.r]);
         }
     }
 
@@ -44,14 +46,14 @@ struct Piece* State_neighbor_piece(
 
 int State_height_at(const struct State* state, const struct Coords* coords)
 {
-    struct Piece* piece = state->grid[coords->q][coords->r];
-    if (!piece) {
+    uint8_t id = state->grid[coords->q][coords->r];
+    if (!id) {
         return 0;
     }
     int height = 1;
-    while (piece->on_top) {
+    while (State_piece(state, id)->on_top) {
         height++;
-        piece = piece->on_top;
+        id = State_piece(state, id)->on_top;
     }
     return height;
 }
@@ -67,39 +69,145 @@ void State_derive_piece_players(struct State* state)
 
 void State_derive_grid(struct State* state)
 {
-    memset(state->grid, 0, sizeof(struct Piece*) * GRID_SIZE * GRID_SIZE);
+    memset(state->grid, NO_PIECE, sizeof(uint8_t) * GRID_SIZE * GRID_SIZE);
 
     for (int p = 0; p < NUM_PLAYERS; p++) {
         for (int i = 0; i < state->piece_count[p]; i++) {
             struct Piece* piece = &state->pieces[p][i];
+            uint8_t id = Piece_id(p, i);
 
-            // Check to see if this piece is under another piece
+            // Check to see if this piece is on top of another piece
             // that's already on the grid
-            struct Piece* p = state->grid[piece->coords.q][piece->coords.r];
-            while (p && p->on_top) {
-                if (p->on_top == piece) {
+            uint8_t below = state->grid[piece->coords.q][piece->coords.r];
+            while (below && State_piece(state, below)->on_top) {
+                if (State_piece(state, below)->on_top == id) {
                     goto skip;
                 }
-                p = p->on_top;
+                below = State_piece(state, below)->on_top;
             }
 
-            state->grid[piece->coords.q][piece->coords.r] = piece;
+            state->grid[piece->coords.q][piece->coords.r] = id;
         skip:
             continue;
         }
     }
 }
 
+uint64_t zobrist_pieces[NUM_PLAYERS][NUM_PIECETYPES][MAX_HEIGHTS][NUM_CELLS];
+uint64_t zobrist_turn;
+
+void init_state()
+{
+    uint64_t x = 0;
+    for (int p = 0; p < NUM_PLAYERS; p++) {
+        for (int t = 0; t < NUM_PIECETYPES; t++) {
+            for (int h = 0; h < MAX_HEIGHTS; h++) {
+                for (int cell = 0; cell < NUM_CELLS; cell++) {
+                    zobrist_pieces[p][t][h][cell] = splitmix64(&x);
+                }
+            }
+        }
+    }
+    zobrist_turn = splitmix64(&x);
+}
+
+uint64_t Piece_zobrist(const struct Piece* piece, int height)
+{
+    return zobrist_pieces[piece->player][piece->type][height][Coords_cell(&piece->coords)];
+}
+
+void State_derive_hash(struct State* state)
+{
+    state->hash = state->turn == P2 ? zobrist_turn : 0;
+    for (int cell = 0; cell < NUM_CELLS; cell++) {
+        uint8_t id = state->cells[cell];
+        for (int height = 0; id; height++) {
+            const struct Piece* piece = State_piece(state, id);
+            state->hash ^= Piece_zobrist(piece, height);
+            id = piece->on_top;
+        }
+    }
+}
+
+// Sets the bottom piece at a cell, for when it's being occupied or
+// vacated, keeping the neighbor masks around it up to date
+void State_set_cell(struct State* state, uint16_t cell, uint8_t id)
+{
+    state->cells[cell] = id;
+    for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+        uint8_t* mask = &state->neighbor_masks[Cell_move(cell, d)];
+        if (id) {
+            *mask |= 1 << OPPOSITE[d];
+        } else {
+            *mask &= ~(1 << OPPOSITE[d]);
+        }
+    }
+}
+
+void State_derive_neighbor_masks(struct State* state)
+{
+    for (int cell = 0; cell < NUM_CELLS; cell++) {
+        state->neighbor_masks[cell] = 0;
+        for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+            if (state->cells[Cell_move(cell, d)]) {
+                state->neighbor_masks[cell] |= 1 << d;
+            }
+        }
+    }
+}
+
+// Updates the bitboards for a hex whose pieces have changed
+void State_update_tops(struct State* state, const struct Coords* coords)
+{
+    Bitboard_reset(&state->tops[P1], coords);
+    Bitboard_reset(&state->tops[P2], coords);
+
+    uint8_t id = state->grid[coords->q][coords->r];
+    if (!id) {
+        Bitboard_reset(&state->occupied, coords);
+        return;
+    }
+
+    while (State_piece(state, id)->on_top) {
+        id = State_piece(state, id)->on_top;
+    }
+    Bitboard_set(&state->occupied, coords);
+    Bitboard_set(&state->tops[State_piece(state, id)->player], coords);
+}
+
+void State_derive_tops(struct State* state)
+{
+    Bitboard_clear(&state->occupied);
+    Bitboard_clear(&state->tops[P1]);
+    Bitboard_clear(&state->tops[P2]);
+
+    for (int p = 0; p < NUM_PLAYERS; p++) {
+        for (int i = 0; i < state->piece_count[p]; i++) {
+            struct Piece* piece = &state->pieces[p][i];
+            if (piece->on_top) {
+                continue;
+            }
+            Bitboard_set(&state->occupied, &piece->coords);
+            Bitboard_set(&state->tops[p], &piece->coords);
+        }
+    }
+}
+
 void State_add_action(struct State* state, int piecei,
     const struct Coords* from, const struct Coords* to)
 {
-    struct Action* action = &state->actions[state->action_count++];
+    uint16_t actioni = state->action_count++;
+    struct Action* action = &state->actions[actioni];
     action->from = *from;
     action->to = *to;
 
     struct Piece* piece = &state->pieces[state->turn][piecei];
-    struct Piece* turn_queen = state->queens[state->turn];
-    struct Piece* other_queen = state->queens[!state->turn];
+    struct Piece* turn_queen = state->queens[state->turn]
+        ? State_piece(state, state->queens[state->turn])
+        : NULL;
+    struct Piece* other_queen = state->queens[!state->turn]
+        ? State_piece(state, state->queens[!state->turn])
+        : NULL;
 
     bool draw_action = false;
 
@@ -110,7 +218,7 @@ void State_add_action(struct State* state, int piecei,
         && (!Coords_adjacent(&turn_queen->coords, from)
             || from->q == PLACE_ACTION
             || (piece->type == BEETLE
-                && state->grid[from->q][from->r]->on_top))
+                && State_piece(state, state->grid[from->q][from->r])->on_top))
         && !state->grid[to->q][to->r]) {
 
         // ..but allow draws
@@ -120,7 +228,7 @@ void State_add_action(struct State* state, int piecei,
             && !(Coords_adjacent(&other_queen->coords, from)
                 || (from->q == PLACE_ACTION
                     || (piece->type == BEETLE
-                        && state->grid[from->q][from->r]->on_top)))) {
+                        && State_piece(state, state->grid[from->q][from->r])->on_top)))) {
 
             draw_action = true;
 
@@ -134,24 +242,24 @@ void State_add_action(struct State* state, int piecei,
     }
 
     if (other_queen) {
-        if (!state->winning_action
+        if (state->winning_action == NO_ACTION
             && State_hex_neighbor_count(state, &other_queen->coords) == NUM_DIRECTIONS - 1
             && Coords_adjacent(to, &other_queen->coords)
             && (from->q == PLACE_ACTION
                 || (!Coords_adjacent(&other_queen->coords, from)
                     || (piece->type == BEETLE
-                        && state->grid[from->q][from->r]->on_top)))
+                        && State_piece(state, state->grid[from->q][from->r])->on_top)))
             && !state->grid[to->q][to->r]
             && !draw_action) {
 
-            state->winning_action = action;
+            state->winning_action = actioni;
         }
 
         if (Coords_adjacent(to, &other_queen->coords)
             && (from->q == PLACE_ACTION
                 || !Coords_adjacent(&other_queen->coords, from))) {
 
-            state->queen_adjacent_actions[state->queen_adjacent_action_count++] = action;
+            state->queen_adjacent_actions[state->queen_adjacent_action_count++] = actioni;
         }
         // else if (Coords_distance(to, &other_queen->coords) <= 2
         //    && (from->q == PLACE_ACTION
@@ -163,32 +271,30 @@ void State_add_action(struct State* state, int piecei,
 
     if (from->q != PLACE_ACTION) {
         if (piece->type == QUEEN_BEE) {
-            state->queen_moves[state->queen_move_count++] = action;
+            state->queen_moves[state->queen_move_count++] = actioni;
         } else if (piece->type == BEETLE) {
-            state->beetle_moves[state->beetle_move_count++] = action;
+            state->beetle_moves[state->beetle_move_count++] = actioni;
         }
-        state->piece_moves[piecei][state->piece_move_count[piecei]++] = action;
+        state->piece_moves[piecei][state->piece_move_count[piecei]++] = actioni;
     }
 
     // TODO technically, a piece pinning in the center could move left
     // and right and keep the pin, but this won't detect that because the piece
     // is also a neighbor to those spots
-    if (state->neighbor_count[!state->turn][action->to.q][action->to.r] == 1
-        && state->neighbor_count[state->turn][action->to.q][action->to.r] == 0
-        && !State_cut_point_neighbor(state, &action->to)
+    bool from_grid = from->q < GRID_SIZE;
+    if (Bitboard_test(&state->pin_hexes, to)
+        && !State_cut_point_neighbor(state, to)
         // Don't bias moving an already-pinning piece
-        && !(state->neighbor_count[!state->turn][action->from.q][action->from.r] == 1
-            && state->neighbor_count[state->turn][action->from.q][action->from.r] == 0)) {
+        && !(from_grid && Bitboard_test(&state->pin_hexes, from))) {
 
-        state->pin_moves[state->pin_move_count++] = action;
+        state->pin_moves[state->pin_move_count++] = actioni;
 
         if (State_neighbor_piece(state, &action->to)->type == QUEEN_BEE) {
-            state->queen_pin_moves[state->queen_pin_move_count++] = action;
+            state->queen_pin_moves[state->queen_pin_move_count++] = actioni;
         }
     }
 
-    if (state->neighbor_count[state->turn][action->from.q][action->from.r] == 1
-        && state->neighbor_count[!state->turn][action->from.q][action->from.r] == 0) {
+    if (from_grid && Bitboard_test(&state->unpin_hexes, from)) {
         // We can't use this normal test, because it will always be a cut point
         //&& !State_cut_point_neighbor(state, &action->from)) {
         // Don't move to a new location that pins us
@@ -197,140 +303,212 @@ void State_add_action(struct State* state, int piecei,
         //    && state->neighbor_count[!state->turn][action->to.q][action->to.r] == 0)
         //    && !State_cut_point_neighbor(state, &action->to)) {
 
-        state->unpin_moves[state->unpin_move_count++] = action;
+        state->unpin_moves[state->unpin_move_count++] = actioni;
     }
 
-    if (state->queens[state->turn]
+    if (turn_queen
         && action->from.q != PLACE_ACTION
         && action->from.q != PASS_ACTION
-        && State_hex_neighbor_count(state, &state->queens[state->turn]->coords) == NUM_DIRECTIONS - 1
-        && Coords_adjacent(&state->queens[state->turn]->coords, &action->from)
+        && State_hex_neighbor_count(state, &turn_queen->coords) == NUM_DIRECTIONS - 1
+        && Coords_adjacent(&turn_queen->coords, &action->from)
         // TODO I think this is segfaulting; shouldn't any action from have a from on the grid (if not one of the above)?
         //&& !state->grid[action->from.q][action->from.r]->on_top
-        && (!Coords_adjacent(&state->queens[state->turn]->coords, &action->to)
+        && (!Coords_adjacent(&turn_queen->coords, &action->to)
             || state->grid[action->to.q][action->to.r])) {
 
-        state->queen_away_moves[state->queen_away_move_count++] = action;
+        state->queen_away_moves[state->queen_away_move_count++] = actioni;
     }
 }
 
-void State_ant_walk(struct State* state, int piecei,
-    const struct Piece* piece,
-    const struct Coords* coords,
-    bool crumbs[GRID_SIZE][GRID_SIZE])
+// A cell's occupied neighbors, as in neighbor_masks, but with a hex
+// lifted off the hive (i.e. the piece that's moving)
+uint8_t State_lifted_neighbor_mask(const struct State* state, uint16_t cell, uint16_t lifted)
 {
-    if (crumbs[coords->q][coords->r]) {
-        return;
+    uint8_t mask = state->neighbor_masks[cell];
+    for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+        if (Cell_move(cell, d) == lifted) {
+            mask &= ~(1 << d);
+        }
     }
+    return mask;
+}
 
-    // If this is the root call, temporarily remove the piece from the
-    // grid so it can't walk along itself; if it's not the root call,
-    // add it as a move
-    if (&piece->coords == coords) {
-        state->grid[coords->q][coords->r] = NULL;
-    } else {
-        State_add_action(state, piecei, &piece->coords, coords);
+/* Finds everywhere an ant at a cell can walk to, by a depth-first search
+ * along the perimeter, and returns how many places there are. The ant is
+ * lifted off the hive for the walk without changing the state, so it can
+ * be shared by other walks.
+ */
+int State_ant_walk(const struct State* state, uint16_t cell, uint16_t destinations[])
+{
+    int count = 0;
+
+    struct CellSet visited;
+    CellSet_clear(&visited);
+    CellSet_set(&visited, cell);
+
+    uint16_t stack[MAX_PERIMETER];
+    int stack_size = 0;
+    stack[stack_size++] = cell;
+
+    while (stack_size) {
+        uint16_t from = stack[--stack_size];
+        const struct Slides* slides = &slides_map[State_lifted_neighbor_mask(state, from, cell)];
+        for (int i = 0; i < slides->count; i++) {
+            uint16_t to = Cell_move(from, slides->directions[i]);
+            if (!CellSet_test(&visited, to)) {
+                CellSet_set(&visited, to);
+                destinations[count++] = to;
+                stack[stack_size++] = to;
+            }
+        }
     }
 
-    crumbs[coords->q][coords->r] = true;
+    return count;
+}
+
+// Whether a piece can slide between two neighboring empty hexes with
+// a hex lifted off the hive, i.e. whether exactly one of the two hexes
+// beside them is occupied
+bool State_can_slide(const struct State* state,
+    uint16_t from,
+    enum Direction d,
+    uint16_t lifted)
+{
+    uint16_t to = Cell_move(from, d);
+    uint16_t left = Cell_move(from, Direction_rotate(d, -1));
+    uint16_t right = Cell_move(from, Direction_rotate(d, 1));
+    return !(state->cells[from] && from != lifted)
+        && !(state->cells[to] && to != lifted)
+        && (state->cells[left] && left != lifted) != (state->cells[right] && right != lifted);
+}
 
-    for (int d = 0; d < NUM_DIRECTIONS; d++) {
-        struct Coords c = *coords;
-        Coords_move(&c, d);
-        if (!state->grid[c.q][c.r]) {
-            continue;
-        }
+bool State_ant_can_move(const struct State* state, const struct Piece* piece)
+{
+    return piece->type == ANT && !piece->on_top
+        && !state->cut_points[piece->coords.q][piece->coords.r];
+}
 
-        c = *coords;
-        Coords_move(&c, Direction_rotate(d, 2));
-        if (!state->grid[c.q][c.r]) {
-            c = *coords;
-            Coords_move(&c, Direction_rotate(d, 1));
-            if (!state->grid[c.q][c.r]) {
-                State_ant_walk(state, piecei, piece, &c, crumbs);
+/* Adds an ant's moves by looking up the parts of the perimeter it can
+ * reach. The perimeter leaves out the slides around ants, which are the
+ * only ones lifting an ant can change, so it's enough to join up the
+ * components that the ant and those slides connect.
+ */
+void State_add_ant_moves(struct State* state, int piecei, const struct Piece* piece)
+{
+    uint16_t lifted = Coords_cell(&piece->coords);
+
+    // The components either side of each slide around the ants, other
+    // than slides from the ant's own hex, which it starts off with
+    uint8_t slide_components[NUM_ANTS * NUM_DIRECTIONS][2];
+    int slide_count = 0;
+    for (int i = 0; i < state->ant_count; i++) {
+        for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+            uint16_t from = Cell_move(state->ant_cells[i], d);
+            enum Direction slide = Direction_rotate(d, 2);
+            uint16_t to = Cell_move(from, slide);
+            if (from != lifted && to != lifted && State_can_slide(state, from, slide, lifted)) {
+                slide_components[slide_count][0] = state->perimeter_components[from];
+                slide_components[slide_count][1] = state->perimeter_components[to];
+                slide_count++;
             }
         }
+    }
 
-        c = *coords;
-        Coords_move(&c, Direction_rotate(d, -2));
-        if (!state->grid[c.q][c.r]) {
-            c = *coords;
-            Coords_move(&c, Direction_rotate(d, -1));
-            if (!state->grid[c.q][c.r]) {
-                State_ant_walk(state, piecei, piece, &c, crumbs);
+    // Up to one component from each slide out of the ant's hex, and one
+    // more for each slide around the ants
+    uint8_t joined[NUM_DIRECTIONS + NUM_ANTS * NUM_DIRECTIONS];
+    int joined_count = 0;
+    const struct Slides* slides = &slides_map[state->neighbor_masks[lifted]];
+    for (int i = 0; i < slides->count; i++) {
+        uint8_t component = state->perimeter_components[Cell_move(lifted, slides->directions[i])];
+        bool found = false;
+        for (int j = 0; j < joined_count; j++) {
+            found |= joined[j] == component;
+        }
+        if (!found) {
+            joined[joined_count++] = component;
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < slide_count; i++) {
+            bool found[2] = { false, false };
+            for (int j = 0; j < joined_count; j++) {
+                found[0] |= joined[j] == slide_components[i][0];
+                found[1] |= joined[j] == slide_components[i][1];
+            }
+            if (found[0] != found[1]) {
+                joined[joined_count++] = slide_components[i][found[0]];
+                changed = true;
             }
         }
     }
 
-    // Put the piece back on the grid
-    if (&piece->coords == coords) {
-        state->grid[coords->q][coords->r] = (struct Piece*)piece;
+    for (int j = 0; j < joined_count; j++) {
+        for (int i = state->perimeter_component_starts[joined[j]];
+             i < state->perimeter_component_starts[joined[j] + 1];
+             i++) {
+            struct Coords to = Cell_coords(state->perimeter[i]);
+            State_add_action(state, piecei, &piece->coords, &to);
+        }
     }
 }
 
-void State_spider_walk(struct State* state, int piecei,
-    const struct Piece* piece,
-    const struct Coords* coords,
-    bool crumbs[GRID_SIZE][GRID_SIZE],
-    bool tos[GRID_SIZE][GRID_SIZE],
-    int depth)
+/* Finds everywhere a spider at a cell can walk to in exactly three
+ * slides without doubling back, and returns how many places there are.
+ * Like State_ant_walk, the spider is lifted off the hive without changing
+ * the state. Places are found in the same order as walking depth first.
+ */
+int State_spider_walk(const struct State* state, uint16_t cell, uint16_t destinations[])
 {
-    if (crumbs[coords->q][coords->r]) {
-        return;
-    }
+    int count = 0;
 
-    // If this is the root call, temporarily remove the piece from the
-    // grid so it can't walk along itself
-    if (depth == 0) {
-        state->grid[coords->q][coords->r] = NULL;
-    }
+    struct CellSet found;
+    CellSet_clear(&found);
 
-    if (depth == SPIDER_MOVES) {
-        if (!tos[coords->q][coords->r]) {
-            State_add_action(state, piecei, &piece->coords, coords);
-            tos[coords->q][coords->r] = true;
-        }
-        return;
-    }
+    // The walk so far, and the slides left to try from each hex on it
+    uint16_t path[SPIDER_MOVES];
+    const struct Slides* slides[SPIDER_MOVES];
+    int next[SPIDER_MOVES];
 
-    // TODO Do we need to worry about different parts of the search
-    // hitting the same hex at different depths?
-    crumbs[coords->q][coords->r] = true;
+    int depth = 0;
+    path[0] = cell;
+    slides[0] = &slides_map[state->neighbor_masks[cell]];
+    next[0] = 0;
 
-    for (int d = 0; d < NUM_DIRECTIONS; d++) {
-        struct Coords c = *coords;
-        Coords_move(&c, d);
-        if (!state->grid[c.q][c.r]) {
+    while (depth >= 0) {
+        if (next[depth] == slides[depth]->count) {
+            depth--;
             continue;
         }
 
-        c = *coords;
-        Coords_move(&c, Direction_rotate(d, 2));
-        if (!state->grid[c.q][c.r]) {
-            c = *coords;
-            Coords_move(&c, Direction_rotate(d, 1));
-            if (!state->grid[c.q][c.r]) {
-                State_spider_walk(state, piecei, piece, &c, crumbs, tos, depth + 1);
-            }
+        uint16_t to = Cell_move(path[depth], slides[depth]->directions[next[depth]++]);
+
+        bool doubled_back = false;
+        for (int i = 0; i <= depth; i++) {
+            doubled_back |= path[i] == to;
+        }
+        if (doubled_back) {
+            continue;
         }
 
-        c = *coords;
-        Coords_move(&c, Direction_rotate(d, -2));
-        if (!state->grid[c.q][c.r]) {
-            c = *coords;
-            Coords_move(&c, Direction_rotate(d, -1));
-            if (!state->grid[c.q][c.r]) {
-                State_spider_walk(state, piecei, piece, &c, crumbs, tos, depth + 1);
+        if (depth == SPIDER_MOVES - 1) {
+            if (!CellSet_test(&found, to)) {
+                CellSet_set(&found, to);
+                destinations[count++] = to;
             }
+            continue;
         }
-    }
 
-    // Put the piece back on the grid
-    if (depth == 0) {
-        state->grid[coords->q][coords->r] = (struct Piece*)piece;
+        depth++;
+        path[depth] = to;
+        slides[depth] = &slides_map[State_lifted_neighbor_mask(state, to, cell)];
+        next[depth] = 0;
     }
 
-    crumbs[coords->q][coords->r] = false;
+    return count;
 }
 
 /* Finds cut points (i.e. pieces that can't be moved due to the one hive
@@ -343,14 +521,15 @@ void State_derive_cut_points(struct State* state)
 {
     memset(state->cut_points, 0, sizeof(bool) * GRID_SIZE * GRID_SIZE);
     memset(state->cut_point_count, 0, sizeof(uint_fast8_t) * NUM_PLAYERS);
+    state->cut_points_derived = true;
 
     if (state->piece_count[P1] <= 1 && state->piece_count[P2] <= 1) {
         return;
     }
 
-    struct Coords stack[MAX_PIECES];
+    uint16_t stack[MAX_PIECES];
     int_fast8_t sp = 0;
-    stack[sp] = state->pieces[P1][0].coords;
+    stack[sp] = Coords_cell(&state->pieces[P1][0].coords);
 
     uint_fast8_t depth[MAX_PIECES];
     depth[sp] = 0;
@@ -358,10 +537,10 @@ void State_derive_cut_points(struct State* state)
     uint_fast8_t lowpoint[MAX_PIECES];
     lowpoint[sp] = 0;
 
-    // crumbs[q][r] is the same as depth[sp] for a particular Coords
-    int_fast8_t crumbs[GRID_SIZE][GRID_SIZE];
-    memset(&crumbs, -1, sizeof(int_fast8_t) * GRID_SIZE * GRID_SIZE);
-    crumbs[stack[sp].q][stack[sp].r] = 0;
+    // crumbs[cell] is the same as depth[sp] for a particular cell
+    int_fast8_t crumbs[NUM_CELLS];
+    memset(&crumbs, -1, sizeof(int_fast8_t) * NUM_CELLS);
+    crumbs[stack[sp]] = 0;
 
     uint_fast8_t next_direction[MAX_PIECES];
     next_direction[sp] = 0;
@@ -375,7 +554,7 @@ void State_derive_cut_points(struct State* state)
     uint_fast8_t root_children = 0;
 
     while (sp >= 0) {
-        struct Coords head;
+        uint16_t head;
         bool found_head = false;
         // Try each direction looking for an edge
         while (!found_head && next_direction[sp] != NUM_DIRECTIONS) {
@@ -384,18 +563,17 @@ void State_derive_cut_points(struct State* state)
                 next_direction[sp]++;
                 continue;
             }
-            head = stack[sp];
-            Coords_move(&head, next_direction[sp]);
-            if (state->grid[head.q][head.r]) {
+            head = Cell_move(stack[sp], next_direction[sp]);
+            if (state->cells[head]) {
                 found_head = true;
             }
             next_direction[sp]++;
         }
 
         if (found_head) {
-            if (crumbs[head.q][head.r] >= 0) {
-                if (crumbs[head.q][head.r] < lowpoint[sp]) {
-                    lowpoint[sp] = crumbs[head.q][head.r];
+            if (crumbs[head] >= 0) {
+                if (crumbs[head] < lowpoint[sp]) {
+                    lowpoint[sp] = crumbs[head];
                 }
             } else {
                 if (sp == 0) {
@@ -403,7 +581,7 @@ void State_derive_cut_points(struct State* state)
                 }
 
                 depth[sp + 1] = depth[sp] + 1;
-                crumbs[head.q][head.r] = depth[sp] + 1;
+                crumbs[head] = depth[sp] + 1;
                 lowpoint[sp + 1] = depth[sp];
                 next_direction[sp + 1] = 0;
                 parent_direction[sp + 1] = OPPOSITE[next_direction[sp] - 1];
@@ -413,9 +591,9 @@ void State_derive_cut_points(struct State* state)
         } else {
             if (sp != 0) {
                 if (lowpoint[sp] == depth[sp - 1] && (sp - 1 != 0)) {
-                    if (!state->cut_points[stack[sp - 1].q][stack[sp - 1].r]) {
-                        state->cut_points[stack[sp - 1].q][stack[sp - 1].r] = true;
-                        state->cut_point_count[state->grid[stack[sp - 1].q][stack[sp - 1].r]->player]++;
+                    if (!state->cut_point_cells[stack[sp - 1]]) {
+                        state->cut_point_cells[stack[sp - 1]] = true;
+                        state->cut_point_count[State_piece(state, state->cells[stack[sp - 1]])->player]++;
                     }
                 } else {
                     if (lowpoint[sp] < lowpoint[sp - 1]) {
@@ -428,9 +606,9 @@ void State_derive_cut_points(struct State* state)
     }
 
     if (root_children > 1) {
-        if (!state->cut_points[stack[0].q][stack[0].r]) {
-            state->cut_points[stack[0].q][stack[0].r] = true;
-            state->cut_point_count[state->grid[stack[0].q][stack[0].r]->player]++;
+        if (!state->cut_point_cells[stack[0]]) {
+            state->cut_point_cells[stack[0]] = true;
+            state->cut_point_count[State_piece(state, state->cells[stack[0]])->player]++;
         }
     }
 }
@@ -447,9 +625,9 @@ void State_count_cut_points(
         return;
     }
 
-    struct Coords stack[MAX_PIECES];
+    uint16_t stack[MAX_PIECES];
     int_fast8_t sp = 0;
-    stack[sp] = *start_coords;
+    stack[sp] = Coords_cell(start_coords);
 
     uint_fast8_t depth[MAX_PIECES];
     depth[sp] = 0;
@@ -457,10 +635,10 @@ void State_count_cut_points(
     uint_fast8_t lowpoint[MAX_PIECES];
     lowpoint[sp] = 0;
 
-    // crumbs[q][r] is the same as depth[sp] for a particular Coords
-    int_fast8_t crumbs[GRID_SIZE][GRID_SIZE];
-    memset(&crumbs, -1, sizeof(int_fast8_t) * GRID_SIZE * GRID_SIZE);
-    crumbs[stack[sp].q][stack[sp].r] = 0;
+    // crumbs[cell] is the same as depth[sp] for a particular cell
+    int_fast8_t crumbs[NUM_CELLS];
+    memset(&crumbs, -1, sizeof(int_fast8_t) * NUM_CELLS);
+    crumbs[stack[sp]] = 0;
 
     uint_fast8_t next_direction[MAX_PIECES];
     next_direction[sp] = 0;
@@ -474,7 +652,7 @@ void State_count_cut_points(
     uint_fast8_t root_children = 0;
 
     while (sp >= 0) {
-        struct Coords head;
+        uint16_t head;
         bool found_head = false;
         // Try each direction looking for an edge
         while (!found_head && next_direction[sp] != NUM_DIRECTIONS) {
@@ -483,18 +661,17 @@ void State_count_cut_points(
                 next_direction[sp]++;
                 continue;
             }
-            head = stack[sp];
-            Coords_move(&head, next_direction[sp]);
-            if (state->grid[head.q][head.r]) {
+            head = Cell_move(stack[sp], next_direction[sp]);
+            if (state->cells[head]) {
                 found_head = true;
             }
             next_direction[sp]++;
         }
 
         if (found_head) {
-            if (crumbs[head.q][head.r] >= 0) {
-                if (crumbs[head.q][head.r] < lowpoint[sp]) {
-                    lowpoint[sp] = crumbs[head.q][head.r];
+            if (crumbs[head] >= 0) {
+                if (crumbs[head] < lowpoint[sp]) {
+                    lowpoint[sp] = crumbs[head];
                 }
             } else {
                 if (sp == 0) {
@@ -502,7 +679,7 @@ void State_count_cut_points(
                 }
 
                 depth[sp + 1] = depth[sp] + 1;
-                crumbs[head.q][head.r] = depth[sp] + 1;
+                crumbs[head] = depth[sp] + 1;
                 lowpoint[sp + 1] = depth[sp];
                 next_direction[sp + 1] = 0;
                 parent_direction[sp + 1] = OPPOSITE[next_direction[sp] - 1];
@@ -512,7 +689,7 @@ void State_count_cut_points(
         } else {
             if (sp != 0) {
                 if (lowpoint[sp] == depth[sp - 1] && (sp - 1 != 0)) {
-                    cut_points[state->grid[stack[sp - 1].q][stack[sp - 1].r]->player]++;
+                    cut_points[State_piece(state, state->cells[stack[sp - 1]])->player]++;
                 } else {
                     if (lowpoint[sp] < lowpoint[sp - 1]) {
                         lowpoint[sp - 1] = lowpoint[sp];
@@ -524,22 +701,234 @@ void State_count_cut_points(
     }
 
     if (root_children > 1) {
-        cut_points[state->grid[stack[0].q][stack[0].r]->player]++;
+        cut_points[State_piece(state, state->cells[stack[0]])->player]++;
+    }
+}
+
+/* Counts the separate runs of occupied hexes around a hex. Neighbors
+ * that are next to each other around the ring are also adjacent to each
+ * other, so a hex whose neighbors form a single run is never a cut point:
+ * its neighbors stay connected without it.
+ */
+int neighbor_runs(uint8_t mask)
+{
+    if (mask == (1 << NUM_DIRECTIONS) - 1) {
+        return 1;
     }
+
+    // Bit d of previous is whether the neighbor before d is occupied
+    uint8_t previous = ((mask << 1) | (mask >> (NUM_DIRECTIONS - 1))) & ((1 << NUM_DIRECTIONS) - 1);
+    return __builtin_popcount(mask & ~previous);
+}
+
+void State_set_cut_point(struct State* state, const struct Coords* coords, bool cut_point)
+{
+    if (state->cut_points[coords->q][coords->r] == cut_point) {
+        return;
+    }
+
+    state->cut_points[coords->q][coords->r] = cut_point;
+    enum Player player = State_piece(state, state->grid[coords->q][coords->r])->player;
+    if (cut_point) {
+        state->cut_point_count[player]++;
+    } else {
+        state->cut_point_count[player]--;
+    }
+}
+
+/* Updates cut points for a hex that has just been occupied, returning
+ * false if that can't be decided from the hexes around it.
+ *
+ * Adding a hex to the hive can only create a cut point where the new hex
+ * is a leaf, and can only remove cut points the new hex goes around. The
+ * new hex itself is never a cut point, because the hive was connected
+ * without it.
+ */
+bool State_add_cut_points(struct State* state, const struct Coords* coords)
+{
+    uint8_t mask = state->neighbor_masks[Coords_cell(coords)];
+
+    if (__builtin_popcount(mask) == 1) {
+        // The new hex's only neighbor now holds it onto the hive, unless
+        // that's all the hive there is
+        struct Coords neighbor = *coords;
+        Coords_move(&neighbor, __builtin_ctz(mask));
+        if (__builtin_popcount(state->neighbor_masks[Coords_cell(&neighbor)]) > 1) {
+            State_set_cut_point(state, &neighbor, true);
+        }
+        return true;
+    }
+
+    if (neighbor_runs(mask) > 1) {
+        // The new hex could go around cut points anywhere in the hive
+        return state->cut_point_count[P1] + state->cut_point_count[P2] == 0;
+    }
+
+    // With a single run of neighbors, the only new way around a hex is
+    // through the new hex, between the neighbors on either side. A cut
+    // point that's gone around like that stops being one if its own
+    // neighbors now form a single run.
+    for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+        if (!(mask & (1 << d))
+            || !(mask & (1 << Direction_rotate(d, -1)))
+            || !(mask & (1 << Direction_rotate(d, 1)))) {
+            continue;
+        }
+
+        struct Coords neighbor = *coords;
+        Coords_move(&neighbor, d);
+        if (!state->cut_points[neighbor.q][neighbor.r]) {
+            continue;
+        }
+        if (neighbor_runs(state->neighbor_masks[Coords_cell(&neighbor)]) > 1) {
+            return false;
+        }
+        State_set_cut_point(state, &neighbor, false);
+    }
+
+    return true;
+}
+
+/* Updates cut points for a hex that has just been vacated, returning
+ * false if that can't be decided from the hexes around it.
+ *
+ * Removing a hex that wasn't a cut point can only create cut points the
+ * removed hex went around, and can only remove the cut point the removed
+ * hex was a leaf of.
+ */
+bool State_remove_cut_points(struct State* state, const struct Coords* coords)
+{
+    if (state->cut_points[coords->q][coords->r]) {
+        return false;
+    }
+
+    uint8_t mask = state->neighbor_masks[Coords_cell(coords)];
+
+    if (__builtin_popcount(mask) <= 1) {
+        if (mask) {
+            struct Coords neighbor = *coords;
+            Coords_move(&neighbor, __builtin_ctz(mask));
+            if (neighbor_runs(state->neighbor_masks[Coords_cell(&neighbor)]) > 1) {
+                return false;
+            }
+            State_set_cut_point(state, &neighbor, false);
+        }
+        return true;
+    }
+
+    if (neighbor_runs(mask) > 1) {
+        return false;
+    }
+
+    // With a single run of neighbors, only the neighbors within the run
+    // lose a way around them
+    for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+        if (!(mask & (1 << d))
+            || !(mask & (1 << Direction_rotate(d, -1)))
+            || !(mask & (1 << Direction_rotate(d, 1)))) {
+            continue;
+        }
+
+        struct Coords neighbor = *coords;
+        Coords_move(&neighbor, d);
+        if (!state->cut_points[neighbor.q][neighbor.r]
+            && neighbor_runs(state->neighbor_masks[Coords_cell(&neighbor)]) > 1) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Keeps cut points up to date as a hex is occupied or vacated, falling
+// back to deriving them in full (later, with actions) when necessary
+void State_update_cut_points(struct State* state, const struct Coords* coords, bool occupied)
+{
+    if (!state->cut_points_derived) {
+        return;
+    }
+
+    if (occupied ? !State_add_cut_points(state, coords)
+                 : !State_remove_cut_points(state, coords)) {
+        state->cut_points_derived = false;
+    }
+}
+
+// Finds the components of the perimeter around the ants that can move,
+// breadth first, with the perimeter list itself as the queue
+void State_derive_perimeter(struct State* state)
+{
+    uint16_t* perimeter = state->perimeter;
+    uint8_t* components = state->perimeter_components;
+
+    // Clear the last perimeter, rather than every cell
+    for (int i = 0; i < state->perimeter_count; i++) {
+        components[perimeter[i]] = 0;
+    }
+    state->perimeter_count = 0;
+
+    state->ant_count = 0;
+    for (int i = 0; i < state->piece_count[state->turn]; i++) {
+        const struct Piece* ant = &state->pieces[state->turn][i];
+        if (State_ant_can_move(state, ant)) {
+            state->ant_cells[state->ant_count++] = Coords_cell(&ant->coords);
+        }
+    }
+    if (!state->ant_count) {
+        return;
+    }
+
+    // Which ants each cell neighbors, to leave out the slides around them
+    uint8_t ant_neighbors[NUM_CELLS];
+    memset(ant_neighbors, 0, sizeof(uint8_t) * NUM_CELLS);
+    for (int i = 0; i < state->ant_count; i++) {
+        for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+            ant_neighbors[Cell_move(state->ant_cells[i], d)] |= 1 << i;
+        }
+    }
+
+    int count = 0;
+    uint8_t component = 0;
+    for (int i = 0; i < state->ant_count; i++) {
+        for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+            uint16_t start = Cell_move(state->ant_cells[i], d);
+            if (state->cells[start] || components[start]) {
+                continue;
+            }
+
+            state->perimeter_component_starts[++component] = count;
+            components[start] = component;
+            perimeter[count++] = start;
+
+            for (int head = state->perimeter_component_starts[component]; head < count; head++) {
+                uint16_t cell = perimeter[head];
+                const struct Slides* slides = &slides_map[state->neighbor_masks[cell]];
+                for (int j = 0; j < slides->count; j++) {
+                    uint16_t next = Cell_move(cell, slides->directions[j]);
+                    if (!components[next] && !(ant_neighbors[cell] & ant_neighbors[next])) {
+                        components[next] = component;
+                        perimeter[count++] = next;
+                    }
+                }
+            }
+        }
+    }
+    state->perimeter_count = count;
+    state->perimeter_component_starts[component + 1] = count;
 }
 
 void State_derive_piece_pointers(struct State* state)
 {
     for (int p = 0; p < NUM_PLAYERS; p++) {
-        state->queens[p] = NULL;
+        state->queens[p] = NO_PIECE;
         state->beetle_count[p] = 0;
         for (int i = 0; i < state->piece_count[p]; i++) {
             if (state->pieces[p][i].type == QUEEN_BEE) {
-                state->queens[p] = &state->pieces[p][i];
+                state->queens[p] = Piece_id(p, i);
             }
 
             if (state->pieces[p][i].type == BEETLE) {
-                state->beetles[p][state->beetle_count[p]++] = &state->pieces[p][i];
+                state->beetles[p][state->beetle_count[p]++] = Piece_id(p, i);
             }
         }
     }
@@ -598,7 +987,7 @@ void State_derive_result(struct State* state)
         if (!state->queens[p]) {
             continue;
         }
-        struct Piece* queen = state->queens[p];
+        struct Piece* queen = State_piece(state, state->queens[p]);
 
         int neighbors = State_hex_neighbor_count(state, &queen->coords);
         if (neighbors == 6) {
@@ -632,20 +1021,18 @@ void State_derive_piece_moves(struct State* state, int piecei)
     // One hive rule
     if (state->cut_points[piece->coords.q][piece->coords.r]) {
         // Beetles on top of the hive ignore one hive rule
-        if (piece->type != BEETLE || state->grid[coords->q][coords->r] == piece) {
+        if (piece->type != BEETLE || state->grid[coords->q][coords->r] == Piece_id(state->turn, piecei)) {
             return;
         }
     }
 
-    bool crumbs[GRID_SIZE][GRID_SIZE];
     switch (piece->type) {
     case ANT:
-        memset(crumbs, 0, sizeof(bool) * GRID_SIZE * GRID_SIZE);
-        State_ant_walk(state, piecei, piece, coords, crumbs);
+        State_add_ant_moves(state, piecei, piece);
         break;
 
     case BEETLE: {
-        bool on_top = state->grid[coords->q][coords->r] != piece;
+        bool on_top = state->grid[coords->q][coords->r] != Piece_id(state->turn, piecei);
 
         if (on_top) {
             for (int d = 0; d < NUM_DIRECTIONS; d++) {
@@ -683,13 +1070,14 @@ void State_derive_piece_moves(struct State* state, int piecei)
             break;
         }
 
+        uint8_t mask = state->neighbor_masks[Coords_cell(coords)];
         for (int d = 0; d < NUM_DIRECTIONS; d++) {
             // Look for adjacent pieces
-            struct Coords c = *coords;
-            Coords_move(&c, d);
-            if (!state->grid[c.q][c.r]) {
+            if (!(mask & 1 << d)) {
                 continue;
             }
+            struct Coords c = *coords;
+            Coords_move(&c, d);
 
             // Climb on top of adjacent piece
             int move_height = State_height_at(state, &c);
@@ -720,21 +1108,11 @@ void State_derive_piece_moves(struct State* state, int piecei)
             // For every adjacent piece, try to move to the
             // right and left of it, first checking for
             // freedom to move
-            c = *coords;
-            Coords_move(&c, Direction_rotate(d, 2));
-            if (!state->grid[c.q][c.r]) {
-                c = *coords;
-                Coords_move(&c, Direction_rotate(d, 1));
-                if (!state->grid[c.q][c.r]) {
-                    State_add_action(state, piecei, &piece->coords, &c);
-                }
-            }
-            c = *coords;
-            Coords_move(&c, Direction_rotate(d, -2));
-            if (!state->grid[c.q][c.r]) {
-                c = *coords;
-                Coords_move(&c, Direction_rotate(d, -1));
-                if (!state->grid[c.q][c.r]) {
+            for (int turn = 1; turn >= -1; turn -= 2) {
+                if (!(mask & 1 << Direction_rotate(d, 2 * turn))
+                    && !(mask & 1 << Direction_rotate(d, turn))) {
+                    c = *coords;
+                    Coords_move(&c, Direction_rotate(d, turn));
                     State_add_action(state, piecei, &piece->coords, &c);
                 }
             }
@@ -760,49 +1138,32 @@ void State_derive_piece_moves(struct State* state, int piecei)
         }
         break;
 
-    case QUEEN_BEE:
-        for (int d = 0; d < NUM_DIRECTIONS; d++) {
-            // Look for adjacent pieces
+    case QUEEN_BEE: {
+        const struct Slides* slides = &slides_map[state->neighbor_masks[Coords_cell(coords)]];
+        for (int i = 0; i < slides->count; i++) {
             struct Coords c = *coords;
-            Coords_move(&c, d);
-            if (!state->grid[c.q][c.r]) {
-                continue;
-            }
-
-            // For every adjacent piece, try to move to the
-            // right and left of it, first checking for
-            // freedom to move
-            c = *coords;
-            Coords_move(&c, Direction_rotate(d, 2));
-            if (!state->grid[c.q][c.r]) {
-                c = *coords;
-                Coords_move(&c, Direction_rotate(d, 1));
-                if (!state->grid[c.q][c.r]) {
-                    State_add_action(state, piecei, &piece->coords, &c);
-                }
-            }
-            c = *coords;
-            Coords_move(&c, Direction_rotate(d, -2));
-            if (!state->grid[c.q][c.r]) {
-                c = *coords;
-                Coords_move(&c, Direction_rotate(d, -1));
-                if (!state->grid[c.q][c.r]) {
-                    State_add_action(state, piecei, &piece->coords, &c);
-                }
-            }
+            Coords_move(&c, slides->directions[i]);
+            State_add_action(state, piecei, &piece->coords, &c);
         }
         break;
+    }
 
-    case SPIDER:
-        memset(crumbs, 0, sizeof(bool) * GRID_SIZE * GRID_SIZE);
-        bool tos[GRID_SIZE][GRID_SIZE];
-        memset(tos, 0, sizeof(bool) * GRID_SIZE * GRID_SIZE);
-        State_spider_walk(state, piecei, piece, coords, crumbs, tos, 0);
+    case SPIDER: {
+        uint16_t destinations[MAX_PIECE_MOVES];
+        int count = State_spider_walk(state, Coords_cell(coords), destinations);
+        for (int i = 0; i < count; i++) {
+            struct Coords to = Cell_coords(destinations[i]);
+            State_add_action(state, piecei, &piece->coords, &to);
+        }
         break;
     }
+    }
 }
 
-void State_derive_actions(struct State* state)
+/* Clears the action lists, and derives the hexes that places and moves
+ * are found and sorted by, ready for actions to be added
+ */
+void State_start_actions(struct State* state)
 {
     state->action_count = 0;
     for (int i = 0; i < state->piece_count[state->turn]; i++) {
@@ -817,9 +1178,74 @@ void State_derive_actions(struct State* state)
     state->queen_pin_move_count = 0;
     state->beetle_move_count = 0;
 
-    state->winning_action = NULL;
+    state->winning_action = NO_ACTION;
     state->losing_action_count = 0;
 
+    struct Bitboard touch_once[NUM_PLAYERS];
+    struct Bitboard touch[NUM_PLAYERS];
+    for (int p = 0; p < NUM_PLAYERS; p++) {
+        Bitboard_neighbors(&state->tops[p], &touch_once[p], &touch[p]);
+    }
+    Bitboard_and_not(&state->pin_hexes, &touch_once[!state->turn], &touch[state->turn]);
+    Bitboard_and_not(&state->unpin_hexes, &touch_once[state->turn], &touch[!state->turn]);
+
+    // Empty hexes touching only the player's own pieces
+    Bitboard_and_not(&state->place_hexes, &touch[state->turn], &touch[!state->turn]);
+    Bitboard_and_not(&state->place_hexes, &state->place_hexes, &state->occupied);
+}
+
+// Adds the player's places, once both players have pieces down
+void State_add_places(struct State* state)
+{
+    bool pieces_to_place = false;
+    for (int t = 0; t < NUM_PIECETYPES; t++) {
+        if (state->hands[state->turn][t] > 0) {
+            pieces_to_place = true;
+            break;
+        }
+    }
+    if (!pieces_to_place) {
+        return;
+    }
+
+    bool force_queen_place = state->hands[state->turn][QUEEN_BEE] && state->piece_count[state->turn] >= 3;
+
+    struct Bitboard place_spots = state->place_hexes;
+
+    // Spots are still listed in order around the player's pieces,
+    // which keeps actions in a stable order
+    struct Coords place_coords[MAX_PLACE_SPOTS];
+    int place_coords_count = 0;
+    for (int i = 0; i < state->piece_count[state->turn]; i++) {
+        for (int d = 0; d < NUM_DIRECTIONS; d++) {
+            struct Coords coords = state->pieces[state->turn][i].coords;
+            Coords_move(&coords, d);
+
+            if (Bitboard_test(&place_spots, &coords)) {
+                place_coords[place_coords_count++] = coords;
+                Bitboard_reset(&place_spots, &coords);
+            }
+        }
+    }
+    for (int t = 0; t < NUM_PIECETYPES; t++) {
+        if (state->hands[state->turn][t] == 0)
+            continue;
+        if (force_queen_place && t != QUEEN_BEE)
+            continue;
+
+        for (int i = 0; i < place_coords_count; i++) {
+            struct Coords from;
+            from.q = PLACE_ACTION;
+            from.r = t;
+            State_add_action(state, 0, &from, &place_coords[i]);
+        }
+    }
+}
+
+void State_generate_actions(struct State* state)
+{
+    State_start_actions(state);
+
     if (state->result != NO_RESULT) {
         return;
     }
@@ -856,47 +1282,7 @@ void State_derive_actions(struct State* state)
         return;
     }
 
-    // Places
-    bool pieces_to_place = false;
-    for (int t = 0; t < NUM_PIECETYPES; t++) {
-        if (state->hands[state->turn][t] > 0) {
-            pieces_to_place = true;
-            break;
-        }
-    }
-
-    bool force_queen_place = state->hands[state->turn][QUEEN_BEE] && state->piece_count[state->turn] >= 3;
-
-    if (pieces_to_place) {
-        struct Coords place_coords[MAX_PLACE_SPOTS];
-        int place_coords_count = 0;
-        bool place_crumbs[GRID_SIZE][GRID_SIZE];
-        memset(place_crumbs, 0, sizeof(bool) * GRID_SIZE * GRID_SIZE);
-        for (int i = 0; i < state->piece_count[state->turn]; i++) {
-            for (int d = 0; d < NUM_DIRECTIONS; d++) {
-                struct Coords coords = state->pieces[state->turn][i].coords;
-                Coords_move(&coords, d);
-
-                if (!state->grid[coords.q][coords.r] && state->neighbor_count[!state->turn][coords.q][coords.r] == 0 && !place_crumbs[coords.q][coords.r]) {
-                    place_coords[place_coords_count++] = coords;
-                    place_crumbs[coords.q][coords.r] = true;
-                }
-            }
-        }
-        for (int t = 0; t < NUM_PIECETYPES; t++) {
-            if (state->hands[state->turn][t] == 0)
-                continue;
-            if (force_queen_place && t != QUEEN_BEE)
-                continue;
-
-            for (int i = 0; i < place_coords_count; i++) {
-                struct Coords from;
-                from.q = PLACE_ACTION;
-                from.r = t;
-                State_add_action(state, 0, &from, &place_coords[i]);
-            }
-        }
-    }
+    State_add_places(state);
 
     // Moves
 
@@ -905,6 +1291,7 @@ void State_derive_actions(struct State* state)
         return;
     }
 
+    State_derive_perimeter(state);
     for (int i = 0; i < state->piece_count[state->turn]; i++) {
         State_derive_piece_moves(state, i);
     }
@@ -915,6 +1302,63 @@ void State_derive_actions(struct State* state)
     }
 }
 
+/* Derives how many steps over the hive each occupied hex is from the
+ * enemy queen, unless they're already up to date, breadth first with the
+ * hexes found as the queue. The hive is connected, so every occupied hex
+ * is reached, and only those are written; there's nothing to clear.
+ */
+void State_derive_queen_distances(struct State* state)
+{
+    if (state->queen_distances_derived) {
+        return;
+    }
+    state->queen_distances_derived = true;
+
+    if (!state->queens[!state->turn]) {
+        return;
+    }
+
+    struct CellSet reached;
+    CellSet_clear(&reached);
+
+    uint16_t queue[MAX_PIECES];
+    int count = 0;
+    uint16_t start = Coords_cell(&State_piece(state, state->queens[!state->turn])->coords);
+    queue[count++] = start;
+    CellSet_set(&reached, start);
+    state->queen_distances[start] = 0;
+
+    for (int head = 0; head < count; head++) {
+        uint16_t cell = queue[head];
+        for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+            uint16_t next = Cell_move(cell, d);
+            if (!(state->neighbor_masks[cell] & 1 << d) || CellSet_test(&reached, next)) {
+                continue;
+            }
+            CellSet_set(&reached, next);
+            state->queen_distances[next] = state->queen_distances[cell] + 1;
+            queue[count++] = next;
+        }
+    }
+}
+
+/* Derives cut points and actions, unless they're already up to date.
+ * Anything that reads actions after State_act_undoable or State_unact
+ * should call this first.
+ */
+void State_derive_actions(struct State* state)
+{
+    if (state->actions_derived) {
+        return;
+    }
+
+    if (state->result == NO_RESULT && !state->cut_points_derived) {
+        State_derive_cut_points(state);
+    }
+    State_generate_actions(state);
+    state->actions_derived = true;
+}
+
 /* Note on efficiency:
  * State_derive is not guranteed to be efficient, and is intended as a
  * convenient one-stop function for code without efficiency needs. It's
@@ -925,41 +1369,158 @@ void State_derive(struct State* state)
 {
     State_derive_piece_players(state);
     State_derive_grid(state);
-    State_derive_cut_points(state);
+    State_derive_neighbor_masks(state);
+    State_derive_tops(state);
     State_derive_piece_pointers(state);
     State_derive_hands(state);
     State_derive_neighbor_count(state);
+    State_derive_hash(state);
     State_derive_result(state);
+    state->actions_derived = false;
+    state->cut_points_derived = false;
+    state->queen_distances_derived = false;
     State_derive_actions(state);
 }
 
 void State_copy(const struct State* source, struct State* dest)
 {
-    // TODO If we're deriving everything we can, we only need to copy
-    // core information
+    // Everything is stored by id and index, so there's nothing to fix up
+    // or re-derive
     memcpy(dest, source, sizeof(struct State));
+}
+
+/* Copies what's derived with actions to a state with the same core
+ * information (e.g. one walked down and back up from it), copying each
+ * list only as far as it's in use. That's a small part of a State_copy.
+ */
+void State_copy_actions(const struct State* source, struct State* dest)
+{
+    if (!dest->cut_points_derived && source->cut_points_derived) {
+        memcpy(dest->cut_points, source->cut_points, sizeof(source->cut_points));
+        memcpy(dest->cut_point_count, source->cut_point_count, sizeof(source->cut_point_count));
+        dest->cut_points_derived = true;
+    }
+
+    dest->queen_distances_derived = false;
+    dest->actions_derived = source->actions_derived;
+    if (!source->actions_derived) {
+        return;
+    }
+
+    dest->pin_hexes = source->pin_hexes;
+    dest->unpin_hexes = source->unpin_hexes;
+    dest->place_hexes = source->place_hexes;
+
+    // Clear the last perimeter, rather than every cell
+    for (int i = 0; i < dest->perimeter_count; i++) {
+        dest->perimeter_components[dest->perimeter[i]] = 0;
+    }
+    memcpy(dest->ant_cells, source->ant_cells, sizeof(uint16_t) * source->ant_count);
+    dest->ant_count = source->ant_count;
+    memcpy(dest->perimeter, source->perimeter, sizeof(uint16_t) * source->perimeter_count);
+    // There's at most a component for each hex, and one past the last
+    memcpy(dest->perimeter_component_starts, source->perimeter_component_starts,
+        sizeof(uint16_t) * (source->perimeter_count + 2));
+    dest->perimeter_count = source->perimeter_count;
+    for (int i = 0; i < source->perimeter_count; i++) {
+        dest->perimeter_components[source->perimeter[i]] = source->perimeter_components[source->perimeter[i]];
+    }
+
+    // Losing actions are kept at the end of the list
+    memcpy(dest->actions, source->actions, sizeof(struct Action) * source->action_count);
+    memcpy(&dest->actions[MAX_ACTIONS - source->losing_action_count],
+        &source->actions[MAX_ACTIONS - source->losing_action_count],
+        sizeof(struct Action) * source->losing_action_count);
+    dest->action_count = source->action_count;
+    dest->winning_action = source->winning_action;
+    dest->losing_action_count = source->losing_action_count;
+
+    for (int i = 0; i < source->piece_count[source->turn]; i++) {
+        memcpy(dest->piece_moves[i], source->piece_moves[i], sizeof(uint16_t) * source->piece_move_count[i]);
+    }
+    memcpy(dest->piece_move_count, source->piece_move_count, sizeof(source->piece_move_count));
+
+    memcpy(dest->queen_moves, source->queen_moves, sizeof(uint16_t) * source->queen_move_count);
+    dest->queen_move_count = source->queen_move_count;
+    memcpy(dest->queen_adjacent_actions, source->queen_adjacent_actions, sizeof(uint16_t) * source->queen_adjacent_action_count);
+    dest->queen_adjacent_action_count = source->queen_adjacent_action_count;
+    memcpy(dest->queen_away_moves, source->queen_away_moves, sizeof(uint16_t) * source->queen_away_move_count);
+    dest->queen_away_move_count = source->queen_away_move_count;
+    memcpy(dest->queen_nearby_actions, source->queen_nearby_actions, sizeof(uint16_t) * source->queen_nearby_action_count);
+    dest->queen_nearby_action_count = source->queen_nearby_action_count;
+    memcpy(dest->pin_moves, source->pin_moves, sizeof(uint16_t) * source->pin_move_count);
+    dest->pin_move_count = source->pin_move_count;
+    memcpy(dest->unpin_moves, source->unpin_moves, sizeof(uint16_t) * source->unpin_move_count);
+    dest->unpin_move_count = source->unpin_move_count;
+    memcpy(dest->queen_pin_moves, source->queen_pin_moves, sizeof(uint16_t) * source->queen_pin_move_count);
+    dest->queen_pin_move_count = source->queen_pin_move_count;
+    memcpy(dest->beetle_moves, source->beetle_moves, sizeof(uint16_t) * source->beetle_move_count);
+    dest->beetle_move_count = source->beetle_move_count;
+}
+
+void State_to_position(const struct State* state, struct Position* position)
+{
+    memset(position, 0, sizeof(struct Position));
+    position->turn = state->turn;
 
-    // Transfer on_top pointers
     for (int p = 0; p < NUM_PLAYERS; p++) {
-        for (int i = 0; i < source->piece_count[p]; i++) {
-            const struct Piece* source_piece = &source->pieces[p][i];
-            if (!source_piece->on_top) {
-                continue;
+        position->piece_count[p] = state->piece_count[p];
+        for (int i = 0; i < state->piece_count[p]; i++) {
+            const struct Piece* piece = &state->pieces[p][i];
+            struct PositionPiece* position_piece = &position->pieces[p][i];
+            position_piece->q = piece->coords.q;
+            position_piece->r = piece->coords.r;
+            position_piece->type = piece->type;
+
+            uint8_t id = state->grid[piece->coords.q][piece->coords.r];
+            while (id != Piece_id(p, i)) {
+                position_piece->height++;
+                id = State_piece(state, id)->on_top;
             }
+        }
+    }
+}
+
+void State_from_position(struct State* state, const struct Position* position)
+{
+    memset(state, 0, sizeof(struct State));
+    state->turn = position->turn;
+
+    for (int p = 0; p < NUM_PLAYERS; p++) {
+        state->piece_count[p] = position->piece_count[p];
+        for (int i = 0; i < position->piece_count[p]; i++) {
+            struct Piece* piece = &state->pieces[p][i];
+            piece->type = position->pieces[p][i].type;
+            piece->coords.q = position->pieces[p][i].q;
+            piece->coords.r = position->pieces[p][i].r;
+        }
+    }
+
+    // Restack pieces from the bottom up, so every piece's stack has been
+    // built up to just below it by the time it's placed
+    for (int height = 0; height <= MAX_ABOVE; height++) {
+        for (int p = 0; p < NUM_PLAYERS; p++) {
+            for (int i = 0; i < position->piece_count[p]; i++) {
+                if (position->pieces[p][i].height != height) {
+                    continue;
+                }
+
+                struct Coords* coords = &state->pieces[p][i].coords;
+                if (height == 0) {
+                    state->grid[coords->q][coords->r] = Piece_id(p, i);
+                    continue;
+                }
 
-            struct Piece* dest_piece = &dest->pieces[p][i];
-            struct Piece* source_on_top = source_piece->on_top;
-            for (int j = 0; j < source->piece_count[source_on_top->player]; j++) {
-                if (&source->pieces[source_on_top->player][j] == source_on_top) {
-                    dest_piece->on_top = &dest->pieces[source_on_top->player][j];
-                    break;
+                struct Piece* below = State_piece(state, state->grid[coords->q][coords->r]);
+                while (below->on_top) {
+                    below = State_piece(state, below->on_top);
                 }
+                below->on_top = Piece_id(p, i);
             }
         }
     }
 
-    // TODO We can optimize this by only deriving what we need to
-    State_derive(dest);
+    State_derive(state);
 }
 
 void State_new(struct State* state)
@@ -968,25 +1529,19 @@ void State_new(struct State* state)
     State_derive(state);
 }
 
-void State_act(struct State* state, const struct Action* action)
+/* Applies an action to the core information and to the derived
+ * information that's kept up to date incrementally. Cut points and
+ * actions are only marked stale.
+ */
+void State_apply(struct State* state, const struct Action* action)
 {
-#ifdef CHECK_ACTIONS
-    bool valid_action = false;
-    for (int i = 0; i < state->action_count; i++) {
-        if (!memcmp(&state->actions[i], action, sizeof(struct Action))) {
-            valid_action = true;
-            break;
-        }
-    }
-    if (!valid_action) {
-        exit(ERROR_ILLEGAL_ACTION);
-    }
-#endif
+    state->actions_derived = false;
+    state->queen_distances_derived = false;
+    state->hash ^= zobrist_turn;
 
     // Pass action
     if (action->from.q == PASS_ACTION) {
         state->turn = !state->turn;
-        State_derive_actions(state);
         return;
     }
 
@@ -994,17 +1549,22 @@ void State_act(struct State* state, const struct Action* action)
 
     // Place action
     if (action->from.q == PLACE_ACTION) {
-        piece = &state->pieces[state->turn][state->piece_count[state->turn]];
+        uint8_t id = Piece_id(state->turn, state->piece_count[state->turn]);
+        piece = State_piece(state, id);
         piece->type = action->from.r;
         piece->coords.q = action->to.q;
         piece->coords.r = action->to.r;
+        piece->on_top = NO_PIECE;
         piece->player = state->turn;
+        state->hash ^= Piece_zobrist(piece, 0);
 
-        state->grid[action->to.q][action->to.r] = piece;
+        State_set_cell(state, Coords_cell(&action->to), id);
+        State_update_tops(state, &action->to);
+        State_update_cut_points(state, &action->to, true);
         if (piece->type == QUEEN_BEE) {
-            state->queens[state->turn] = piece;
+            state->queens[state->turn] = id;
         } else if (piece->type == BEETLE) {
-            state->beetles[state->turn][state->beetle_count[state->turn]++] = piece;
+            state->beetles[state->turn][state->beetle_count[state->turn]++] = id;
         }
 
         state->piece_count[state->turn]++;
@@ -1017,55 +1577,181 @@ void State_act(struct State* state, const struct Action* action)
         }
 
         state->turn = !state->turn;
-        State_derive_cut_points(state);
-        State_derive_actions(state);
         return;
     }
 
     // Move action
 
     // Find piece being moved, walking up a stack of pieces if necessary
-    piece = state->grid[action->from.q][action->from.r];
+    uint8_t id = state->grid[action->from.q][action->from.r];
+    piece = State_piece(state, id);
     struct Piece* under = NULL;
+    int height = 0;
     while (piece->on_top) {
         under = piece;
-        piece = piece->on_top;
+        id = piece->on_top;
+        piece = State_piece(state, id);
+        height++;
     }
 
     // Move piece to new location
+    state->hash ^= Piece_zobrist(piece, height);
     piece->coords.q = action->to.q;
     piece->coords.r = action->to.r;
     State_add_neighor_count(state, &action->from, piece->player, -1);
     State_add_neighor_count(state, &action->to, piece->player, 1);
 
     if (under) {
-        under->on_top = NULL;
+        under->on_top = NO_PIECE;
         State_add_neighor_count(state, &action->from, under->player, 1);
     } else {
-        state->grid[action->from.q][action->from.r] = NULL;
+        State_set_cell(state, Coords_cell(&action->from), NO_PIECE);
+        State_update_cut_points(state, &action->from, false);
     }
 
     // If there's already a piece at new location, put moved piece on top of it
+    height = 0;
     if (state->grid[action->to.q][action->to.r]) {
-        struct Piece* p = state->grid[action->to.q][action->to.r];
+        struct Piece* p = State_piece(state, state->grid[action->to.q][action->to.r]);
+        height++;
         while (p->on_top) {
-            p = p->on_top;
+            p = State_piece(state, p->on_top);
+            height++;
         }
-        p->on_top = piece;
+        p->on_top = id;
         State_add_neighor_count(state, &action->to, p->player, -1);
     } else {
-        state->grid[action->to.q][action->to.r] = piece;
+        State_set_cell(state, Coords_cell(&action->to), id);
+        State_update_cut_points(state, &action->to, true);
     }
+    state->hash ^= Piece_zobrist(piece, height);
+    State_update_tops(state, &action->from);
+    State_update_tops(state, &action->to);
 
     state->turn = !state->turn;
     State_derive_result(state);
-    if (state->result == NO_RESULT) {
-        // TODO don't need to do this for beetle moves on hive
-        State_derive_cut_points(state);
+}
+
+void State_act(struct State* state, const struct Action* action)
+{
+#ifdef CHECK_ACTIONS
+    bool valid_action = false;
+    for (int i = 0; i < state->action_count; i++) {
+        if (!memcmp(&state->actions[i], action, sizeof(struct Action))) {
+            valid_action = true;
+            break;
+        }
     }
+    if (!valid_action) {
+        exit(ERROR_ILLEGAL_ACTION);
+    }
+#endif
+
+    State_apply(state, action);
     State_derive_actions(state);
 }
 
+/* Like State_act, but records what State_unact needs to reverse the
+ * action, and leaves cut points and actions to be derived on demand
+ */
+void State_act_undoable(struct State* state,
+    const struct Action* action,
+    struct Undo* undo)
+{
+    undo->action = *action;
+    undo->result = state->result;
+    State_apply(state, action);
+}
+
+/* Reverses an action taken with State_act_undoable.
+ *
+ * Only the information State_apply maintains incrementally is restored;
+ * cut points and actions are marked stale, and are derived again by
+ * State_derive_actions when they're needed.
+ */
+void State_unact(struct State* state, const struct Undo* undo)
+{
+    const struct Action* action = &undo->action;
+
+    state->actions_derived = false;
+    state->queen_distances_derived = false;
+    state->hash ^= zobrist_turn;
+    state->turn = !state->turn;
+    state->result = undo->result;
+
+    // Pass action
+    if (action->from.q == PASS_ACTION) {
+        return;
+    }
+
+    struct Piece* piece;
+
+    // Place action; the placed piece is always the last one in the list
+    if (action->from.q == PLACE_ACTION) {
+        piece = &state->pieces[state->turn][--state->piece_count[state->turn]];
+        state->hash ^= Piece_zobrist(piece, 0);
+
+        State_set_cell(state, Coords_cell(&action->to), NO_PIECE);
+        State_update_tops(state, &action->to);
+        State_update_cut_points(state, &action->to, false);
+        if (piece->type == QUEEN_BEE) {
+            state->queens[state->turn] = NO_PIECE;
+        } else if (piece->type == BEETLE) {
+            state->beetle_count[state->turn]--;
+        }
+
+        state->hands[state->turn][piece->type]++;
+        State_add_neighor_count(state, &piece->coords, piece->player, -1);
+        return;
+    }
+
+    // Move action; the moved piece is on top of the stack it moved to
+    uint8_t id = state->grid[action->to.q][action->to.r];
+    piece = State_piece(state, id);
+    struct Piece* under = NULL;
+    int height = 0;
+    while (piece->on_top) {
+        under = piece;
+        id = piece->on_top;
+        piece = State_piece(state, id);
+        height++;
+    }
+
+    // Move piece back to its old location. It's put back before it's
+    // taken off its new location, so the hive is never split in between.
+    state->hash ^= Piece_zobrist(piece, height);
+    piece->coords.q = action->from.q;
+    piece->coords.r = action->from.r;
+    State_add_neighor_count(state, &action->to, piece->player, -1);
+    State_add_neighor_count(state, &action->from, piece->player, 1);
+
+    height = 0;
+    if (state->grid[action->from.q][action->from.r]) {
+        struct Piece* p = State_piece(state, state->grid[action->from.q][action->from.r]);
+        height++;
+        while (p->on_top) {
+            p = State_piece(state, p->on_top);
+            height++;
+        }
+        p->on_top = id;
+        State_add_neighor_count(state, &action->from, p->player, -1);
+    } else {
+        State_set_cell(state, Coords_cell(&action->from), id);
+        State_update_cut_points(state, &action->from, true);
+    }
+    state->hash ^= Piece_zobrist(piece, height);
+
+    if (under) {
+        under->on_top = NO_PIECE;
+        State_add_neighor_count(state, &action->to, under->player, 1);
+    } else {
+        State_set_cell(state, Coords_cell(&action->to), NO_PIECE);
+        State_update_cut_points(state, &action->to, false);
+    }
+    State_update_tops(state, &action->from);
+    State_update_tops(state, &action->to);
+}
+
 int State_hex_neighbor_count(const struct State* state, const struct Coords* coords)
 {
     return state->neighbor_count[P1][coords->q][coords->r]
@@ -4,13 +4,13 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "bitboard.h"
 #include "coords.h"
 
 #define NUM_PLAYERS 2
 
 #define PLAYER_PIECES 11
 #define MAX_PIECES (PLAYER_PIECES * NUM_PLAYERS)
-#define GRID_SIZE 24
 
 #define NUM_PIECETYPES 5
 #define NUM_ANTS 3
@@ -45,6 +45,7 @@
 #define MAX_PLACE_SPOTS 26
 
 #define MAX_ABOVE (NUM_PLAYERS * NUM_BEETLES)
+#define MAX_HEIGHTS (MAX_ABOVE + 1)
 #define MAX_STACK_SIZE (1 MAX_STACK_SIZE)
 
 // If Action.from.q == PLACE_ACTION, it means the action is a place, with
@@ -55,6 +56,15 @@
 
 #define SPIDER_MOVES 3
 
+// Every empty hex touching the hive touches at least one piece
+#define MAX_PERIMETER (MAX_PIECES * NUM_DIRECTIONS)
+
+// Pieces and actions are referred to by id and index rather than by
+// pointer, so that a State can be copied with a plain memcpy. Piece ids
+// start at 1, so that 0 can mean no piece (e.g. an empty grid hex).
+#define NO_PIECE 0
+#define NO_ACTION UINT16_MAX
+
 enum Player {
     P1 = 0,
     P2
@@ -82,13 +92,39 @@ struct Piece {
     // Core information
     enum PieceType type;
     struct Coords coords;
-    // Points to a beetle on top of the piece
-    struct Piece* on_top;
+    // Id of a beetle on top of the piece
+    uint8_t on_top;
 
     // Derived information
     enum Player player;
 };
 
+/* A compact encoding of a state's core information, a couple of bytes
+ * per piece. Unlike a State it holds nothing derived, so it's cheap to
+ * store in bulk, hash, or write out as-is. Unused pieces are zeroed, so
+ * two equal positions are also equal byte for byte.
+ */
+struct PositionPiece {
+    uint16_t q : 5;
+    uint16_t r : 5;
+    uint16_t type : 3;
+    // Number of pieces below this one in its stack
+    uint16_t height : 3;
+};
+
+struct Position {
+    struct PositionPiece pieces[NUM_PLAYERS][PLAYER_PIECES];
+    uint8_t piece_count[NUM_PLAYERS];
+    uint8_t turn;
+};
+
+/* A state is in three parts: the core information, which is all a
+ * Position holds; information derived from it that's kept up to date as
+ * actions are taken and undone; and information derived with actions,
+ * which makes up most of the struct. Searches walk a single state down
+ * and back up rather than copying it, and State_copy_actions puts back
+ * just the part derived with actions, as far as it's in use.
+ */
 struct State {
     // Core information
     struct Piece pieces[NUM_PLAYERS][PLAYER_PIECES];
@@ -96,62 +132,188 @@ struct State {
 
     enum Player turn;
 
-    // Derived information
-    struct Piece* grid[GRID_SIZE][GRID_SIZE];
+    // Derived information, kept up to date as actions are taken and undone
+
+    // Zobrist hash of the core information; see State_hash
+    uint64_t hash;
+
+    enum Result result;
+
+    // Id of the bottom piece at each hex, by coords or by cell
+    union {
+        uint8_t grid[GRID_SIZE][GRID_SIZE];
+        uint8_t cells[NUM_CELLS];
+    };
+
+    // Which of each cell's neighbors are occupied, with bit d set if the
+    // neighbor in direction d is
+    uint8_t neighbor_masks[NUM_CELLS];
+
+    // Hexes with any pieces, and with each player's piece on top
+    struct Bitboard occupied;
+    struct Bitboard tops[NUM_PLAYERS];
+
+    uint8_t queens[NUM_PLAYERS];
+    uint8_t beetles[NUM_PLAYERS][NUM_BEETLES];
+    uint_fast8_t beetle_count[NUM_PLAYERS];
+
+    uint_fast8_t hands[NUM_PLAYERS][NUM_PIECETYPES];
+
+    uint_fast8_t neighbor_count[NUM_PLAYERS][GRID_SIZE][GRID_SIZE];
+
+    // Whether cut points and actions are up to date. State_act_undoable
+    // and State_unact leave actions to be derived when they're asked for.
+    // Cut points are updated as pieces come and go where that can be
+    // decided locally, and are otherwise derived in full with actions.
+    bool actions_derived;
+    bool cut_points_derived;
+    union {
+        bool cut_points[GRID_SIZE][GRID_SIZE];
+        bool cut_point_cells[NUM_CELLS];
+    };
+    uint_fast8_t cut_point_count[NUM_PLAYERS];
+
+    // Derived with actions
+
+    // For the player to move: hexes that touch a single enemy piece and
+    // none of their own (i.e. pinning ones), hexes that touch a single one
+    // of their own pieces and no enemy ones, and empty hexes that only
+    // touch their own pieces (i.e. ones to place on)
+    struct Bitboard pin_hexes;
+    struct Bitboard unpin_hexes;
+    struct Bitboard place_hexes;
+
+    /* Once pieces can move: the ants that can move, and the perimeter of
+     * the hive around them, as a graph of the empty hexes touching it with
+     * an edge for each slide between them (see slides_map), less the
+     * slides around the ants. Hexes are listed by connected component,
+     * numbered from 1; perimeter_components has each cell's component, or
+     * 0 if it's not on the perimeter.
+     */
+    uint16_t ant_cells[NUM_ANTS];
+    uint_fast8_t ant_count;
+    uint16_t perimeter[MAX_PERIMETER];
+    uint_fast16_t perimeter_count;
+    uint16_t perimeter_component_starts[MAX_PERIMETER + 2];
+    uint8_t perimeter_components[NUM_CELLS];
+
+    // Derived on demand by State_derive_queen_distances, once the enemy
+    // queen is placed: how many steps over the hive each occupied hex is
+    // from the queen of the player not to move (other hexes are garbage)
+    bool queen_distances_derived;
+    uint8_t queen_distances[NUM_CELLS];
 
     struct Action actions[MAX_ACTIONS];
     uint_fast16_t action_count;
 
-    struct Action* winning_action;
+    // Indices into actions, or NO_ACTION
+    uint16_t winning_action;
     uint_fast16_t losing_action_count;
 
-    struct Piece* queens[NUM_PLAYERS];
-    struct Action* queen_moves[MAX_QUEEN_MOVES];
+    uint16_t queen_moves[MAX_QUEEN_MOVES];
     uint_fast8_t queen_move_count;
 
-    struct Piece* beetles[NUM_PLAYERS][NUM_BEETLES];
-    uint_fast8_t beetle_count[NUM_PLAYERS];
-
-    struct Action* piece_moves[PLAYER_PIECES][MAX_PIECE_MOVES];
+    uint16_t piece_moves[PLAYER_PIECES][MAX_PIECE_MOVES];
     uint_fast16_t piece_move_count[PLAYER_PIECES];
 
-    struct Action* queen_adjacent_actions[MAX_ACTIONS];
+    uint16_t queen_adjacent_actions[MAX_ACTIONS];
     uint_fast16_t queen_adjacent_action_count;
 
-    struct Action* queen_away_moves[MAX_ACTIONS];
+    uint16_t queen_away_moves[MAX_ACTIONS];
     uint_fast16_t queen_away_move_count;
 
-    struct Action* queen_nearby_actions[MAX_ACTIONS];
+    uint16_t queen_nearby_actions[MAX_ACTIONS];
     uint_fast16_t queen_nearby_action_count;
 
-    struct Action* pin_moves[MAX_ACTIONS];
+    uint16_t pin_moves[MAX_ACTIONS];
     uint_fast16_t pin_move_count;
 
-    struct Action* unpin_moves[MAX_ACTIONS];
+    uint16_t unpin_moves[MAX_ACTIONS];
     uint_fast16_t unpin_move_count;
 
-    struct Action* queen_pin_moves[MAX_ACTIONS];
+    uint16_t queen_pin_moves[MAX_ACTIONS];
     uint_fast16_t queen_pin_move_count;
 
-    struct Action* beetle_moves[MAX_BEETLE_MOVES];
+    uint16_t beetle_moves[MAX_BEETLE_MOVES];
     uint_fast8_t beetle_move_count;
+};
 
-    uint_fast8_t hands[NUM_PLAYERS][NUM_PIECETYPES];
-
-    uint_fast8_t neighbor_count[NUM_PLAYERS][GRID_SIZE][GRID_SIZE];
-
-    bool cut_points[GRID_SIZE][GRID_SIZE];
-    uint_fast8_t cut_point_count[NUM_PLAYERS];
-
+// Everything State_unact needs to reverse an action
+struct Undo {
+    struct Action action;
     enum Result result;
 };
 
+/* Zobrist keys for a piece of each player and type, at each height in a
+ * stack (the number of pieces below it) and at each cell, and for it
+ * being P2's turn. A position's hash is the XOR of the keys that apply.
+ * They're filled in by init_state from a fixed seed, so hashes are the
+ * same from one run to the next.
+ */
+extern uint64_t zobrist_pieces[NUM_PLAYERS][NUM_PIECETYPES][MAX_HEIGHTS][NUM_CELLS];
+extern uint64_t zobrist_turn;
+
+void init_state();
+
+static inline uint8_t Piece_id(enum Player player, int i)
+{
+    return player * PLAYER_PIECES + i + 1;
+}
+
+static inline struct Piece* State_piece(const struct State* state, uint8_t id)
+{
+    return (struct Piece*)&state->pieces[(id - 1) / PLAYER_PIECES][(id - 1) % PLAYER_PIECES];
+}
+
+static inline uint64_t State_hash(const struct State* state)
+{
+    return state->hash;
+}
+
+/**
+ * returns whether a piece moved or placed on a hex would pin one of the
+ * player's own pieces: the hex is an empty unpin hex (rather than one a
+ * beetle would climb onto), and its single neighbor isn't a cut point
+ * already
+ */
+static inline bool State_own_pin_hex(const struct State* state, const struct Coords* coords)
+{
+    if (!Bitboard_test(&state->unpin_hexes, coords) || state->grid[coords->q][coords->r]) {
+        return false;
+    }
+
+    uint16_t cell = Coords_cell(coords);
+    return !state->cut_point_cells[Cell_move(cell, __builtin_ctz(state->neighbor_masks[cell]))];
+}
+
 void State_new(struct State* state);
 void State_derive(struct State* state);
 
 void State_copy(const struct State* source, struct State* dest);
+void State_copy_actions(const struct State* source, struct State* dest);
+
+void State_to_position(const struct State* state, struct Position* position);
+void State_from_position(struct State* state, const struct Position* position);
 
 void State_act(struct State* state, const struct Action* action);
+void State_act_undoable(struct State* state,
+    const struct Action* action,
+    struct Undo* undo);
+void State_unact(struct State* state, const struct Undo* undo);
+
+void State_derive_cut_points(struct State* state);
+void State_derive_actions(struct State* state);
+void State_derive_queen_distances(struct State* state);
+
+/* For finding only some of the actions, e.g. a single piece's: once
+ * cut points are derived, State_start_actions clears the action lists,
+ * and the others add the player's places and a piece's moves, sorted
+ * as State_derive_actions would. Ants need the perimeter derived first.
+ */
+void State_start_actions(struct State* state);
+void State_add_places(struct State* state);
+void State_derive_perimeter(struct State* state);
+void State_derive_piece_moves(struct State* state, int piecei);
 
 int State_hex_neighbor_count(const struct State* state, const struct Coords* coords);
 
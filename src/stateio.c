@@ -48,7 +48,7 @@ void State_normalize(struct State* state)
         piece_in_gap = false;
         for (int q = 0; q < GRID_SIZE; q++) {
             for (int r = 0; r < NORMALIZATION_GAP; r++) {
-                if (state->grid[q][r] != NULL) {
+                if (state->grid[q][r]) {
                     piece_in_gap = true;
                     break;
                 }
@@ -62,7 +62,7 @@ void State_normalize(struct State* state)
         piece_in_gap = false;
         for (int r = 0; r < GRID_SIZE; r++) {
             for (int q = 0; q < NORMALIZATION_GAP; q++) {
-                if (state->grid[q][r] != NULL) {
+                if (state->grid[q][r]) {
                     piece_in_gap = true;
                     break;
                 }
@@ -78,7 +78,7 @@ void State_normalize(struct State* state)
     do {
         piece_on_edge = false;
         for (int q = 0; q < GRID_SIZE; q++) {
-            if (state->grid[q][GRID_SIZE - 1] != NULL) {
+            if (state->grid[q][GRID_SIZE - 1]) {
                 piece_on_edge = true;
                 break;
             }
@@ -90,7 +90,7 @@ void State_normalize(struct State* state)
     do {
         piece_on_edge = false;
         for (int r = 0; r < GRID_SIZE; r++) {
-            if (state->grid[GRID_SIZE - 1][r] != NULL) {
+            if (state->grid[GRID_SIZE - 1][r]) {
                 piece_on_edge = true;
                 break;
             }
@@ -105,7 +105,7 @@ void State_normalize(struct State* state)
     piece_on_edge = false;
     while (!piece_on_edge) {
         for (int q = 0; q < GRID_SIZE; q++) {
-            if (state->grid[q][NORMALIZATION_GAP] != NULL) {
+            if (state->grid[q][NORMALIZATION_GAP]) {
                 piece_on_edge = true;
                 break;
             }
@@ -117,7 +117,7 @@ void State_normalize(struct State* state)
     piece_on_edge = false;
     while (!piece_on_edge) {
         for (int r = 0; r < GRID_SIZE; r++) {
-            if (state->grid[NORMALIZATION_GAP][r] != NULL) {
+            if (state->grid[NORMALIZATION_GAP][r]) {
                 piece_on_edge = true;
                 break;
             }
@@ -150,10 +150,11 @@ void State_print(const struct State* s, FILE* stream)
             int x = q;
             int y = 2 * r + q;
             // Adjust for NORMALIZATION_GAP so that it's not included the output
-            grid[x][y] = state.grid[q + NORMALIZATION_GAP][r + NORMALIZATION_GAP];
-
-            if (!grid[x][y])
+            uint8_t id = state.grid[q + NORMALIZATION_GAP][r + NORMALIZATION_GAP];
+            if (!id)
                 continue;
+
+            grid[x][y] = State_piece(&state, id);
             if (x < min_x)
                 min_x = x;
             if (x > max_x)
@@ -191,11 +192,11 @@ void State_print(const struct State* s, FILE* stream)
             bool se = x < max_x && y < max_y && grid[x + 1][y + 1];
 
             struct Piece* above_here[MAX_ABOVE];
-            Piece_pieces_above(here, above_here);
+            Piece_pieces_above(&state, here, above_here);
             struct Piece* above_ne[MAX_ABOVE];
-            Piece_pieces_above(ne, above_ne);
+            Piece_pieces_above(&state, ne, above_ne);
             struct Piece* above_nw[MAX_ABOVE];
-            Piece_pieces_above(nw, above_nw);
+            Piece_pieces_above(&state, nw, above_nw);
 
             fputc(above_nw[3]    ? Piece_char(above_nw[3])
                     : here || nw ? '/'
@@ -222,9 +223,9 @@ void State_print(const struct State* s, FILE* stream)
             struct Piece* se = (x < max_x && y < max_y) ? grid[x + 1][y + 1] : NULL;
 
             struct Piece* above_here[MAX_ABOVE];
-            Piece_pieces_above(here, above_here);
+            Piece_pieces_above(&state, here, above_here);
             struct Piece* above_se[MAX_ABOVE];
-            Piece_pieces_above(se, above_se);
+            Piece_pieces_above(&state, se, above_se);
 
             fputc(here || sw ? '\\' : ' ', stream);
             fputc(above_here[1] ? Piece_char(above_here[1])
@@ -290,8 +291,8 @@ void State_from_string(struct State* state, const char string[])
             exit(ERROR_PIECE_PARSE);
         }
 
-        state->pieces[piece.player][state->piece_count[piece.player]] = piece;
-        struct Piece* state_piece = &state->pieces[piece.player][state->piece_count[piece.player]++];
+        uint8_t id = Piece_id(piece.player, state->piece_count[piece.player]);
+        state->pieces[piece.player][state->piece_count[piece.player]++] = piece;
 
         if (state->grid[piece.coords.q][piece.coords.r]) {
             if (piece.type != BEETLE) {
@@ -305,13 +306,13 @@ void State_from_string(struct State* state, const char string[])
                 exit(ERROR_ILLEGAL_PIECE_ON_HIVE);
             }
 
-            struct Piece* p = state->grid[piece.coords.q][piece.coords.r];
+            struct Piece* p = State_piece(state, state->grid[piece.coords.q][piece.coords.r]);
             while (p->on_top) {
-                p = p->on_top;
+                p = State_piece(state, p->on_top);
             }
-            p->on_top = state_piece;
+            p->on_top = id;
         } else {
-            state->grid[piece.coords.q][piece.coords.r] = state_piece;
+            state->grid[piece.coords.q][piece.coords.r] = id;
         }
     }
 
@@ -320,34 +321,26 @@ void State_from_string(struct State* state, const char string[])
     State_derive(state);
 }
 
-void State_to_string(const struct State* s, char string[])
+void State_to_string(const struct State* state, char string[])
 {
-    struct State state = *s;
-
     memset(string, 0, sizeof(char) * STATE_STRING_SIZE);
     int c = 0;
 
     for (int q = 0; q < GRID_SIZE; q += 1) {
         for (int r = 0; r < GRID_SIZE; r += 1) {
-            if (!state.grid[q][r])
-                continue;
-
-            string[c++] = Piece_char(state.grid[q][r]);
-            string[c++] = 'a' + q;
-            string[c++] = 'a' + r;
-
-            struct Piece* p = state.grid[q][r]->on_top;
-            while (p) {
+            uint8_t id = state->grid[q][r];
+            while (id) {
+                struct Piece* p = State_piece(state, id);
                 string[c++] = Piece_char(p);
                 string[c++] = 'a' + q;
                 string[c++] = 'a' + r;
 
-                p = p->on_top;
+                id = p->on_top;
             }
         }
     }
 
-    string[c++] = '1' + state.turn;
+    string[c++] = '1' + state->turn;
 }
 
 void Action_from_string(struct Action* action, const char string[])
@@ -7,18 +7,20 @@
 struct Piece*
 State_top_piece(const struct State* state, unsigned int q, unsigned r)
 {
-    struct Piece* piece = state->grid[q][r];
-    if (!piece)
-        return piece;
+    if (!state->grid[q][r])
+        return NULL;
 
+    struct Piece* piece = State_piece(state, state->grid[q][r]);
     while (piece->on_top) {
-        piece = piece->on_top;
+        piece = State_piece(state, piece->on_top);
     }
 
     return piece;
 }
 
-void Piece_pieces_above(const struct Piece* piece, struct Piece* above[])
+void Piece_pieces_above(const struct State* state,
+    const struct Piece* piece,
+    struct Piece* above[])
 {
     const struct Piece* p = piece;
     memset(above, 0, sizeof(struct Piece*) * MAX_ABOVE);
@@ -32,14 +34,14 @@ void Piece_pieces_above(const struct Piece* piece, struct Piece* above[])
             return;
         }
 
-        above[i] = p->on_top;
-        p = p->on_top;
+        above[i] = State_piece(state, p->on_top);
+        p = above[i];
     }
 }
 
 bool Piece_compare(const struct Piece* piece, const struct Piece* other)
 {
-    return !(piece->type == other->type && piece->coords.q == other->coords.q && piece->coords.r == other->coords.r && piece->player == other->player && (bool)piece->on_top == (bool)other->on_top && !(piece->on_top && Piece_compare(piece->on_top, other->on_top)));
+    return !(piece->type == other->type && piece->coords.q == other->coords.q && piece->coords.r == other->coords.r && piece->player == other->player && piece->on_top == other->on_top);
 }
 
 bool State_compare(const struct State* state,
@@ -70,16 +72,7 @@ bool State_compare(const struct State* state,
 
     for (int q = 0; q < GRID_SIZE; q++) {
         for (int r = 0; r < GRID_SIZE; r++) {
-            if (state->grid[q][r] == NULL) {
-                if (other->grid[q][r] == NULL) {
-                    continue;
-                }
-                if (debug_print)
-                    fprintf(stderr, "Different grid NULLs\n");
-                return true;
-            }
-
-            if (Piece_compare(state->grid[q][r], other->grid[q][r])) {
+            if (state->grid[q][r] != other->grid[q][r]) {
                 if (debug_print)
                     fprintf(stderr, "Different grid\n");
                 return true;
@@ -95,6 +88,25 @@ bool State_compare(const struct State* state,
         }
     }
 
+    if (state->hash != other->hash) {
+        if (debug_print)
+            fprintf(stderr, "Different hash\n");
+        return true;
+    }
+
+    if (memcmp(state->neighbor_masks, other->neighbor_masks, NUM_CELLS)) {
+        if (debug_print)
+            fprintf(stderr, "Different neighbor_masks\n");
+        return true;
+    }
+
+    if (memcmp(&state->occupied, &other->occupied, sizeof(struct Bitboard))
+        || memcmp(state->tops, other->tops, sizeof(struct Bitboard) * NUM_PLAYERS)) {
+        if (debug_print)
+            fprintf(stderr, "Different bitboards\n");
+        return true;
+    }
+
     if (state->action_count != other->action_count) {
         if (debug_print)
             fprintf(stderr,
@@ -13,11 +13,16 @@
 struct Piece*
 State_top_piece(const struct State* state, unsigned int q, unsigned r);
 
-void Piece_pieces_above(const struct Piece* piece, struct Piece* above[]);
+void Piece_pieces_above(const struct State* state,
+    const struct Piece* piece,
+    struct Piece* above[]);
 
 // Following the basic interface of strcmp, these return true if a
 // difference is found, and false if the structs are (functionally)
-// identical. We can't just memcmp because of all the pointers.
+// identical. We can't just memcmp because derived information that isn't
+// compared (e.g. action order) may differ. Pieces above are compared by
+// id, so pieces are only comparable within states with the same piece
+// order.
 bool Piece_compare(const struct Piece* piece, const struct Piece* other);
 bool State_compare(const struct State* state,
     const struct State* other,
@@ -1,18 +1,80 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "evaluate.h"
+#include "mcts.h"
 #include "minimax.h"
+#include "pool.h"
+#include "rng.h"
 #include "state.h"
 #include "stateio.h"
 #include "stateutil.h"
+#include "think.h"
 
 uint_fast8_t State_articulation_points(const struct State* state, struct Coords points[]);
 void State_derive_neighbor_count(struct State* state);
 int State_height_at(const struct State* state, const struct Coords* coords);
 bool State_is_queen_sidestep(const struct State* state, const struct Action* action);
-int State_beetle_seek_path(const struct State* state, const struct Piece* piece, struct Coords* path);
+bool State_cut_point_neighbor(const struct State* state, const struct Coords* coords);
+const struct Action* State_beetle_seek_move(struct State* state, const struct Piece* beetle);
+void State_add_ant_moves(struct State* state, int piecei, const struct Piece* piece);
+int State_ant_walk(const struct State* state, uint16_t cell, uint16_t destinations[]);
+void State_add_action(struct State* state, int piecei,
+    const struct Coords* from, const struct Coords* to);
+bool State_derive_light_actions(struct State* state, struct Rng* rng);
+void NodeArena_init(struct NodeArena* arena);
+uint32_t NodeArena_alloc(struct NodeArena* arena, uint32_t count);
+void NodeTable_init(struct NodeTable* table, int bits);
+uint32_t NodeTable_find_or_add(struct NodeTable* table, uint64_t hash, uint32_t nodei);
+void NodeTable_free(struct NodeTable* table);
+float Node_follow(struct MCTSContext* context, struct Node* link, uint32_t nodei, struct State* state);
+uint32_t Node_open(struct MCTSContext* context, struct Node* node, uint16_t opened, const struct State* state);
+uint32_t Node_select_puct(struct MCTSContext* context, struct Node* node, const struct State* state);
+uint32_t Node_select_widening(struct MCTSContext* context,
+    struct Node* node,
+    const struct State* state,
+    unsigned int visits);
+int Node_select_uct(struct MCTSContext* context, const struct Node* children, int count, unsigned int visits);
+#ifdef __SSE2__
+int Node_select_uct_sse(const struct Node* children, int count, float uctc, float log_parent_visits);
+#endif
+
+// Counts the calls of each task, for testing the pool
+void count_task(void* arg, int i)
+{
+    __atomic_fetch_add(&((int*)arg)[i], 1, __ATOMIC_RELAXED);
+}
+
+// Calls pool_run from inside one of its tasks, with three counts each
+void nested_task(void* arg, int i)
+{
+    pool_run(3, count_task, &((int*)arg)[3 * i]);
+}
+
+// A search of its own for each task, for testing searches run at once
+struct SearchTask {
+    const struct State* state;
+    const struct MCTSOptions* options;
+    struct MCTSResults results;
+};
+
+void search_task(void* arg, int i)
+{
+    struct SearchTask* search = &((struct SearchTask*)arg)[i];
+    mcts(search->state, &search->results, search->options);
+}
+
+// Priors rising with the action's index, so that they're opened last first
+void rising_priors(const struct State* state, const struct MCTSOptions* options, float priors[])
+{
+    for (int i = 0; i < state->action_count; i++) {
+        priors[i] = (float)(i + 1) / state->action_count;
+    }
+}
 
 int main(int argc, char* argv[])
 {
@@ -26,6 +88,63 @@ int main(int argc, char* argv[])
     srand(seed);
 
     init_coords();
+    init_state();
+
+    // Bitboard shifts
+    {
+        for (int q = 0; q < GRID_SIZE; q++) {
+            for (int r = 0; r < GRID_SIZE; r++) {
+                struct Coords coords = { q, r };
+                struct Bitboard bitboard;
+                Bitboard_clear(&bitboard);
+                Bitboard_set(&bitboard, &coords);
+
+                for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+                    struct Coords moved = coords;
+                    Coords_move(&moved, d);
+
+                    struct Bitboard shifted;
+                    Bitboard_shift(&shifted, &bitboard, d);
+                    if (!Bitboard_test(&shifted, &moved)) {
+                        printf("Bitboard shift doesn't match Coords_move\n");
+                    }
+                    Bitboard_reset(&shifted, &moved);
+                    if (!Bitboard_empty(&shifted)) {
+                        printf("Bitboard shift sets more than one hex\n");
+                    }
+                }
+            }
+        }
+    }
+
+    // Bitboard neighbors
+    {
+        State_new(&state);
+        bool match = true;
+        for (int i = 0; i < 100 && match && state.result == NO_RESULT; i++) {
+            for (int p = 0; p < NUM_PLAYERS; p++) {
+                struct Bitboard once;
+                struct Bitboard any;
+                Bitboard_neighbors(&state.tops[p], &once, &any);
+
+                for (int q = 0; q < GRID_SIZE; q++) {
+                    for (int r = 0; r < GRID_SIZE; r++) {
+                        struct Coords coords = { q, r };
+                        if (Bitboard_test(&once, &coords) != (state.neighbor_count[p][q][r] == 1)
+                            || Bitboard_test(&any, &coords) != (state.neighbor_count[p][q][r] > 0)) {
+                            match = false;
+                        }
+                    }
+                }
+            }
+
+            if (!match) {
+                printf("Bitboard neighbors don't match neighbor counts\n");
+                State_print(&state, stdout);
+            }
+            State_act(&state, &state.actions[rand() % state.action_count]);
+        }
+    }
 
     // Grid derive
     {
@@ -38,10 +157,10 @@ int main(int argc, char* argv[])
         state.pieces[P2][state.piece_count[P2]++].coords.r = 0;
         State_derive(&state);
 
-        if (state.grid[0][1] != &state.pieces[P1][0]) {
+        if (state.grid[0][1] != Piece_id(P1, 0)) {
             printf("grid[0][1] does not match state.pieces[P1][0]\n");
         }
-        if (state.grid[1][0] != &state.pieces[P2][0]) {
+        if (state.grid[1][0] != Piece_id(P2, 0)) {
             printf("grid[1][0] does not match state.pieces[P2][0]\n");
         }
     }
@@ -76,7 +195,7 @@ int main(int argc, char* argv[])
         p1.type = GRASSHOPPER;
         p1.coords.q = 3;
         p1.coords.r = 5;
-        p1.on_top = NULL;
+        p1.on_top = NO_PIECE;
         p1.player = P1;
 
         struct Piece p2 = p1;
@@ -93,7 +212,7 @@ int main(int argc, char* argv[])
 
         struct Piece b1 = p1;
         b1.type = BEETLE;
-        p1.on_top = &b1;
+        p1.on_top = Piece_id(P1, 1);
         if (!Piece_compare(&p1, &b1)) {
             printf("Piece and beetle on top of it compare as same\n");
         }
@@ -102,7 +221,7 @@ int main(int argc, char* argv[])
             printf("Pieces compare as same with different pieces above them\n");
         }
 
-        p2.on_top = &b1;
+        p2.on_top = Piece_id(P1, 1);
         if (Piece_compare(&p1, &p2)) {
             printf("Pieces compare as different when identical (with pieces above "
                    "them\n");
@@ -358,6 +477,39 @@ int main(int argc, char* argv[])
         }
     }
 
+    // Updating articulation points
+    {
+        struct State state;
+        struct Undo undos[200];
+        int undo_count = 0;
+
+        State_new(&state);
+        for (int i = 0; i < 400; i++) {
+            if (i < 200 && state.result == NO_RESULT) {
+                State_derive_actions(&state);
+                State_act_undoable(&state, &state.actions[rand() % state.action_count], &undos[undo_count++]);
+            } else if (undo_count) {
+                State_unact(&state, &undos[--undo_count]);
+            } else {
+                break;
+            }
+
+            if (!state.cut_points_derived) {
+                continue;
+            }
+
+            struct State derived;
+            State_copy(&state, &derived);
+            State_derive_cut_points(&derived);
+            if (memcmp(state.cut_points, derived.cut_points, sizeof(state.cut_points))
+                || memcmp(state.cut_point_count, derived.cut_point_count, sizeof(state.cut_point_count))) {
+                printf("Updated cut points different from derived cut points:\n");
+                State_print(&state, stdout);
+                break;
+            }
+        }
+    }
+
     // Queen moves
     {
         int move_count;
@@ -414,7 +566,7 @@ int main(int argc, char* argv[])
             if (action->from.q == PLACE_ACTION)
                 continue;
 
-            struct Piece* piece = state.grid[action->from.q][action->from.r];
+            struct Piece* piece = State_piece(&state, state.grid[action->from.q][action->from.r]);
             if (piece->type != GRASSHOPPER)
                 continue;
 
@@ -444,7 +596,7 @@ int main(int argc, char* argv[])
             if (action->from.q == PLACE_ACTION)
                 continue;
 
-            struct Piece* piece = state.grid[action->from.q][action->from.r];
+            struct Piece* piece = State_piece(&state, state.grid[action->from.q][action->from.r]);
             if (piece->type != SPIDER)
                 continue;
 
@@ -473,7 +625,7 @@ int main(int argc, char* argv[])
             if (action->from.q == PLACE_ACTION)
                 continue;
 
-            struct Piece* piece = state.grid[action->from.q][action->from.r];
+            struct Piece* piece = State_piece(&state, state.grid[action->from.q][action->from.r]);
             if (piece->type != SPIDER)
                 continue;
 
@@ -507,7 +659,7 @@ int main(int argc, char* argv[])
             if (action->from.q == PLACE_ACTION)
                 continue;
 
-            struct Piece* piece = state.grid[action->from.q][action->from.r];
+            struct Piece* piece = State_piece(&state, state.grid[action->from.q][action->from.r]);
             if (piece->type != SPIDER)
                 continue;
 
@@ -532,7 +684,7 @@ int main(int argc, char* argv[])
             if (action->from.q == PLACE_ACTION)
                 continue;
 
-            struct Piece* piece = state.grid[action->from.q][action->from.r];
+            struct Piece* piece = State_piece(&state, state.grid[action->from.q][action->from.r]);
             if (piece->type != BEETLE)
                 continue;
 
@@ -579,7 +731,7 @@ int main(int argc, char* argv[])
             if (action->from.q == PLACE_ACTION)
                 continue;
 
-            struct Piece* piece = state.grid[action->from.q][action->from.r];
+            struct Piece* piece = State_piece(&state, state.grid[action->from.q][action->from.r]);
             if (piece->type != ANT)
                 continue;
 
@@ -593,7 +745,7 @@ int main(int argc, char* argv[])
                 struct Action* action = &state.actions[i];
                 if (action->from.q == PLACE_ACTION)
                     continue;
-                struct Piece* piece = state.grid[action->from.q][action->from.r];
+                struct Piece* piece = State_piece(&state, state.grid[action->from.q][action->from.r]);
                 if (piece->type != ANT)
                     continue;
                 Action_print(&state.actions[i], stdout);
@@ -610,7 +762,7 @@ int main(int argc, char* argv[])
             if (action->from.q == PLACE_ACTION)
                 continue;
 
-            struct Piece* piece = state.grid[action->from.q][action->from.r];
+            struct Piece* piece = State_piece(&state, state.grid[action->from.q][action->from.r]);
             if (piece->type != ANT)
                 continue;
 
@@ -624,7 +776,7 @@ int main(int argc, char* argv[])
                 struct Action* action = &state.actions[i];
                 if (action->from.q == PLACE_ACTION)
                     continue;
-                struct Piece* piece = state.grid[action->from.q][action->from.r];
+                struct Piece* piece = State_piece(&state, state.grid[action->from.q][action->from.r]);
                 if (piece->type != ANT)
                     continue;
                 Action_print(&state.actions[i], stdout);
@@ -632,6 +784,60 @@ int main(int argc, char* argv[])
         }
     }
 
+    // Ant moves from the perimeter
+    {
+        int mismatches = 0;
+        for (int game = 0; game < 20; game++) {
+            State_new(&state);
+            for (int turn = 0; turn < 200 && state.result == NO_RESULT; turn++) {
+                State_derive_actions(&state);
+
+                for (int i = 0; i < state.piece_count[state.turn]; i++) {
+                    struct Piece* piece = &state.pieces[state.turn][i];
+                    if (piece->type != ANT || piece->on_top
+                        || state.cut_points[piece->coords.q][piece->coords.r]
+                        || state.hands[state.turn][QUEEN_BEE]) {
+                        continue;
+                    }
+
+                    bool tos[2][NUM_CELLS];
+                    memset(tos, 0, sizeof(tos));
+                    for (int walk = 0; walk < 2; walk++) {
+                        struct State other;
+                        State_copy(&state, &other);
+                        other.action_count = 0;
+                        other.piece_move_count[i] = 0;
+
+                        if (walk) {
+                            uint16_t destinations[MAX_PIECE_MOVES];
+                            int count = State_ant_walk(&state, Coords_cell(&piece->coords), destinations);
+                            for (int j = 0; j < count; j++) {
+                                struct Coords to = Cell_coords(destinations[j]);
+                                State_add_action(&other, i, &piece->coords, &to);
+                            }
+                        } else {
+                            State_add_ant_moves(&other, i, piece);
+                        }
+
+                        for (int j = 0; j < other.piece_move_count[i]; j++) {
+                            tos[walk][Coords_cell(&other.actions[other.piece_moves[i][j]].to)] = true;
+                        }
+                    }
+
+                    if (memcmp(tos[0], tos[1], sizeof(tos[0]))) {
+                        mismatches++;
+                    }
+                }
+
+                State_act(&state, &state.actions[rand() % state.action_count]);
+            }
+        }
+
+        if (mismatches) {
+            printf("Ant moves from the perimeter differ from walking %d times\n", mismatches);
+        }
+    }
+
     // Piece movement actions
     {
         strcpy(state_string, "QabaacsadqbaAbbsbdacaadagdb1");
@@ -672,6 +878,120 @@ int main(int argc, char* argv[])
         }
     }
 
+    // Undoing actions
+    {
+        strcpy(
+            state_string,
+            "saeAafQbbabebbfGcbbcbSccgcdgcesdaqddgdxAedBfdafeSgeGhbGhcBhdaxdAxe1");
+        State_from_string(&state, state_string);
+
+        struct State other;
+        State_from_string(&other, state_string);
+
+        struct Undo undos[100];
+        int undo_count = 0;
+        while (state.result == NO_RESULT && undo_count < 100) {
+            State_derive_actions(&state);
+            const struct Action* action = state.winning_action != NO_ACTION
+                ? &state.actions[state.winning_action]
+                : &state.actions[rand() % state.action_count];
+            State_act_undoable(&state, action, &undos[undo_count++]);
+        }
+        while (undo_count) {
+            State_unact(&state, &undos[--undo_count]);
+        }
+        State_derive_actions(&state);
+
+        if (State_compare(&state, &other, true)) {
+            printf("State different after undoing actions:\n");
+            State_print(&state, stdout);
+            State_print(&other, stdout);
+        }
+
+        strcpy(state_string, "");
+        State_from_string(&state, state_string);
+        State_from_string(&other, state_string);
+        while (state.result == NO_RESULT && undo_count < 100) {
+            State_derive_actions(&state);
+            const struct Action* action = state.winning_action != NO_ACTION
+                ? &state.actions[state.winning_action]
+                : &state.actions[rand() % state.action_count];
+            State_act_undoable(&state, action, &undos[undo_count++]);
+        }
+        while (undo_count) {
+            State_unact(&state, &undos[--undo_count]);
+        }
+        State_derive_actions(&state);
+
+        if (State_compare(&state, &other, true)) {
+            printf("New state different after undoing actions:\n");
+        }
+    }
+
+    // Positions
+    {
+        struct State state;
+        State_new(&state);
+
+        for (int i = 0; i < 100 && state.result == NO_RESULT; i++) {
+            struct Position position;
+            State_to_position(&state, &position);
+
+            struct State other;
+            State_from_position(&other, &position);
+            if (State_compare(&state, &other, true)) {
+                printf("State different after converting to and from a position:\n");
+                State_print(&state, stdout);
+                State_print(&other, stdout);
+                break;
+            }
+
+            struct Position other_position;
+            State_to_position(&other, &other_position);
+            if (memcmp(&position, &other_position, sizeof(struct Position))) {
+                printf("Position different after converting to and from a state\n");
+                break;
+            }
+
+            State_act(&state, &state.actions[rand() % state.action_count]);
+        }
+
+        if (sizeof(struct Position) > 64) {
+            printf("Position is %lu bytes\n", sizeof(struct Position));
+        }
+    }
+
+    // Hashing
+    {
+        struct State state;
+        struct State other;
+
+        // The same position, with pieces listed in a different order
+        State_from_string(&state, "QabaacsadgbaAbbsbdacaadagdb1");
+        State_from_string(&other, "gdbAbbadaaacQabsadgbasbdaca1");
+        if (State_hash(&state) != State_hash(&other)) {
+            printf("Same position hashes differently\n");
+        }
+
+        State_from_string(&other, "QabaacsadgbaAbbsbdacaadagdb2");
+        if (State_hash(&state) == State_hash(&other)) {
+            printf("Hash doesn't depend on turn\n");
+        }
+
+        State_new(&state);
+        for (int i = 0; i < 200 && state.result == NO_RESULT; i++) {
+            State_to_string(&state, state_string);
+            State_from_string(&other, state_string);
+            if (State_hash(&state) != State_hash(&other)) {
+                printf("Hash not kept up to date:\n");
+                State_print(&state, stdout);
+                break;
+            }
+
+            State_act(&state, &state.actions[rand() % state.action_count]);
+        }
+    }
+
     // Result detection
     {
         strcpy(state_string,
@@ -741,6 +1061,68 @@ int main(int argc, char* argv[])
         if (Coords_adjacent(&c1, &c2)) {
             printf("Not adjacent coords are adjacent\n");
         }
+
+        // Every pair of hexes, including ones across the edges
+        for (int cell = 0; cell < NUM_CELLS; cell++) {
+            c1 = Cell_coords(cell);
+            for (int other = 0; other < NUM_CELLS; other++) {
+                c2 = Cell_coords(other);
+
+                bool adjacent = false;
+                for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+                    struct Coords c = c1;
+                    Coords_move(&c, d);
+                    if (c.q == c2.q && c.r == c2.r) {
+                        adjacent = true;
+                    }
+                }
+
+                if (Coords_adjacent(&c1, &c2) != adjacent) {
+                    printf("Coords adjacency wrong for %d, %d\n", cell, other);
+                }
+            }
+        }
+    }
+
+    // Cell moves
+    {
+        for (int cell = 0; cell < NUM_CELLS; cell++) {
+            struct Coords coords = Cell_coords(cell);
+            if (Coords_cell(&coords) != cell) {
+                printf("Cell %d doesn't convert to and from coords\n", cell);
+            }
+
+            for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+                struct Coords moved = coords;
+                Coords_move(&moved, d);
+                if (Cell_move(cell, d) != Coords_cell(&moved)) {
+                    printf("Cell_move doesn't match Coords_move\n");
+                }
+            }
+        }
+    }
+
+    // Slide table
+    {
+        for (int mask = 0; mask < 1 << NUM_DIRECTIONS; mask++) {
+            int expected = 0;
+            for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+                bool left = mask & 1 << Direction_rotate(d, -1);
+                bool right = mask & 1 << Direction_rotate(d, 1);
+                if (!(mask & 1 << d) && left != right) {
+                    expected |= 1 << d;
+                }
+            }
+
+            int found = 0;
+            for (int i = 0; i < slides_map[mask].count; i++) {
+                found |= 1 << slides_map[mask].directions[i];
+            }
+
+            if (found != expected || __builtin_popcount(found) != slides_map[mask].count) {
+                printf("Wrong slides for neighbor mask %d\n", mask);
+            }
+        }
     }
 
     // Win finding
@@ -750,11 +1132,11 @@ int main(int argc, char* argv[])
             "sbigcgQchbciAcjsdggdhgeeBeeqefGegAehaeiGfcGfdAfgagbBgdbgdSgeaggShb2");
         State_from_string(&state, state_string);
 
-        if (!state.winning_action) {
+        if (state.winning_action == NO_ACTION) {
             printf("No win found\n");
         }
 
-        State_act(&state, state.winning_action);
+        State_act(&state, &state.actions[state.winning_action]);
 
         if (state.result != P2_WIN) {
             printf("Winning move gives unexpected result: %d\n", state.result);
@@ -775,8 +1157,8 @@ int main(int argc, char* argv[])
         // State_from_string(&state, state_string);
         struct Action action;
         while (state.result == NO_RESULT) {
-            if (state.winning_action) {
-                State_act(&state, state.winning_action);
+            if (state.winning_action != NO_ACTION) {
+                State_act(&state, &state.actions[state.winning_action]);
                 continue;
             }
 
@@ -793,8 +1175,8 @@ int main(int argc, char* argv[])
         State_from_string(&state, state_string);
         struct Action action;
         while (state.result == NO_RESULT) {
-            if (state.winning_action) {
-                State_act(&state, state.winning_action);
+            if (state.winning_action != NO_ACTION) {
+                State_act(&state, &state.actions[state.winning_action]);
                 continue;
             }
 
@@ -803,6 +1185,41 @@ int main(int argc, char* argv[])
         }
     }
 
+    // Light actions are among the full ones
+    {
+        struct Rng rng;
+        Rng_seed(&rng, seed);
+        for (int game = 0; game < 10; game++) {
+            State_new(&state);
+            while (state.result == NO_RESULT) {
+                struct State light;
+                State_copy(&state, &light);
+                light.actions_derived = false;
+                if (State_derive_light_actions(&light, &rng)) {
+                    bool passes = light.actions[0].from.q == PASS_ACTION;
+                    if (passes && state.actions[0].from.q != PASS_ACTION) {
+                        printf("Light actions pass when there are actions\n");
+                    }
+                    for (int i = 0; i < light.action_count && !passes; i++) {
+                        bool found = false;
+                        for (int j = 0; j < state.action_count; j++) {
+                            found |= !memcmp(&light.actions[i], &state.actions[j], sizeof(struct Action));
+                        }
+                        if (!found) {
+                            printf("Light action isn't among the full actions\n");
+                        }
+                    }
+                }
+
+                if (state.winning_action != NO_ACTION) {
+                    State_act(&state, &state.actions[state.winning_action]);
+                    continue;
+                }
+                State_act(&state, &state.actions[rand() % state.action_count]);
+            }
+        }
+    }
+
     // Queen must be placed by turn 4
     {
         strcpy(state_string, "gbcgbdgccBdbBebAec1");
@@ -840,6 +1257,28 @@ int main(int argc, char* argv[])
         }
     }
 
+    // Evaluation
+    {
+        strcpy(state_string,
+            "AbdacdbceschadcsddbdfQdggdhgedGeeaefBfcGfdgfeBgbqgcGgdShcShd2");
+        State_from_string(&state, state_string);
+
+        float score = State_evaluate(&state);
+        if (score >= 0) {
+            printf("Losing state evaluates as not losing: %f\n", score);
+        }
+
+        state.turn = !state.turn;
+        if (State_evaluate(&state) != -score) {
+            printf("Evaluation isn't the same for each player\n");
+        }
+
+        State_new(&state);
+        if (State_evaluate(&state) != 0) {
+            printf("New state doesn't evaluate as even\n");
+        }
+    }
+
     // Height calculations
     {
         strcpy(state_string, "BaababBabBacbacbac1");
@@ -941,10 +1380,10 @@ int main(int argc, char* argv[])
         strcpy(state_string, "QbbabeAbfGcbgccqcd2");
         State_from_string(&state, state_string);
 
-        if (!state.queens[P1] || state.queens[P1]->coords.q != 1 || state.queens[P1]->coords.r != 1) {
+        if (!state.queens[P1] || State_piece(&state, state.queens[P1])->coords.q != 1 || State_piece(&state, state.queens[P1])->coords.r != 1) {
             printf("Invalid queen cache for P1\n");
         }
-        if (!state.queens[P2] || state.queens[P2]->coords.q != 2 || state.queens[P2]->coords.r != 3) {
+        if (!state.queens[P2] || State_piece(&state, state.queens[P2])->coords.q != 2 || State_piece(&state, state.queens[P2])->coords.r != 3) {
             printf("Invalid queen cache for P2\n");
         }
     }
@@ -1059,12 +1498,38 @@ int main(int argc, char* argv[])
             struct State after;
             for (int i = 0; i < state.pin_move_count; i++) {
                 State_copy(&state, &after);
-                State_act(&after, state.pin_moves[i]);
+                State_act(&after, &state.actions[state.pin_moves[i]]);
                 State_print(&after, stdout);
             }
         }
     }
 
+    // Own pin actions are the ones to empty hexes touching a single one of
+    // the player's pieces, and no enemy ones, that isn't a cut point
+    {
+        const char* state_strings[] = {
+            "AbbqbcgbdGcdQcescf1",
+            "GabAbaqbbsbwsbxbcbGdbQdcaddAedBtfBufAvegwdgxcbxc1",
+            "saeAafQbbabebbfGcbbcbSccgcdgcesdaqddgdxAedBfdafeSgeGhbGhcBhdaxdAxe1",
+        };
+        for (int s = 0; s < sizeof(state_strings) / sizeof(state_strings[0]); s++) {
+            strcpy(state_string, state_strings[s]);
+            State_from_string(&state, state_string);
+
+            for (int i = 0; i < state.action_count; i++) {
+                const struct Coords* to = &state.actions[i].to;
+                bool expected = state.neighbor_count[state.turn][to->q][to->r] == 1
+                    && state.neighbor_count[!state.turn][to->q][to->r] == 0
+                    && !state.grid[to->q][to->r]
+                    && !State_cut_point_neighbor(&state, to);
+                if (State_own_pin_hex(&state, to) != expected) {
+                    printf("Own pin action wrong for %s: ", state_string);
+                    Action_print(&state.actions[i], stdout);
+                }
+            }
+        }
+    }
+
     // Queen sidestep bug
     {
         strcpy(state_string, "babAacqbbsbcbcbGdbQdc2");
@@ -1100,6 +1565,33 @@ int main(int argc, char* argv[])
     //    }
     //}
 
+    // Queen distances
+    {
+        strcpy(state_string, "saeAafQbbabebbfGcbbcbSccgcdgcesdaqddgdxAedBfdafeSgeGhbGhcBhdaxdAxe1");
+        State_from_string(&state, state_string);
+        State_derive_queen_distances(&state);
+
+        // Each hex is one step further than its closest neighbor
+        uint16_t queen = Coords_cell(&State_piece(&state, state.queens[!state.turn])->coords);
+        for (int cell = 0; cell < NUM_CELLS; cell++) {
+            if (!state.cells[cell] || cell == queen) {
+                continue;
+            }
+
+            int closest = UINT8_MAX;
+            for (enum Direction d = 0; d < NUM_DIRECTIONS; d++) {
+                uint16_t neighbor = Cell_move(cell, d);
+                if (state.cells[neighbor] && state.queen_distances[neighbor] < closest) {
+                    closest = state.queen_distances[neighbor];
+                }
+            }
+            if (state.queen_distances[queen] != 0 || state.queen_distances[cell] != closest + 1) {
+                printf("Queen distances aren't shortest paths over the hive\n");
+                break;
+            }
+        }
+    }
+
     // Beetle seek
     {
         strcpy(state_string, "QbdBbeGcdAcesdcsebgecqfc1");
@@ -1113,30 +1605,702 @@ int main(int argc, char* argv[])
             }
         }
 
-        struct Coords path[MAX_PIECES];
-        int path_size = State_beetle_seek_path(&state, piece, path);
-
-        if (path_size != 4) {
-            printf("Incorrect length for beetle seek path\n");
+        const struct Action* action = State_beetle_seek_move(&state, piece);
+        if (state.queen_distances[Coords_cell(&piece->coords)] != 4) {
+            printf("Incorrect distance for beetle to queen\n");
+        }
+        if (!action || state.queen_distances[Coords_cell(&action->to)] != 3) {
+            printf("Beetle seek move doesn't get closer to queen\n");
         }
     }
     {
+        // The beetle is on top of the queen already
         strcpy(state_string, "QbdGcdAcesdcsebgecbfbqgbBgb1");
         State_from_string(&state, state_string);
 
-        struct Piece* piece = NULL;
-        for (int i = 0; i < state.piece_count[P1]; i++) {
-            piece = &state.pieces[P1][i];
-            if (piece->type == BEETLE) {
+        const struct Piece* beetle = State_piece(&state, state.beetles[P1][0]);
+        if (State_beetle_seek_move(&state, beetle)) {
+            printf("Beetle seeks queen it's on top of\n");
+        }
+    }
+
+    // Node arena
+    {
+        struct NodeArena arena;
+        NodeArena_init(&arena);
+
+        // Children that don't fit in what's left of a chunk start the next
+        uint32_t first = NodeArena_alloc(&arena, NODE_CHUNK_SIZE - 10);
+        uint32_t second = NodeArena_alloc(&arena, 20);
+        uint32_t third = NodeArena_alloc(&arena, NODE_CHUNK_SIZE - 20);
+        uint32_t fourth = NodeArena_alloc(&arena, 1);
+        if (first != 0 || second != NODE_CHUNK_SIZE) {
+            printf("Node arena splits children across chunks\n");
+        }
+        if (third != NODE_CHUNK_SIZE + 20 || fourth != 2 * NODE_CHUNK_SIZE || arena.chunk_count != 3) {
+            printf("Node arena doesn't fill chunks up to the end\n");
+        }
+        if (arena.bytes != 3 * sizeof(struct Node) * NODE_CHUNK_SIZE) {
+            printf("Node arena miscounts its bytes\n");
+        }
+
+        // Children can be walked as an array
+        for (int i = 0; i < 20; i++) {
+            if (NodeArena_node(&arena, second + i) != &NodeArena_node(&arena, second)[i]) {
+                printf("Node arena children aren't contiguous\n");
                 break;
             }
         }
 
-        struct Coords path[MAX_PIECES];
-        int path_size = State_beetle_seek_path(&state, piece, path);
+        NodeArena_free(&arena);
+    }
+    {
+        // Every expansion of a search's tree is in a single chunk
+        strcpy(state_string, "saeAafQbbabebbfGcbbcbSccgcdgcesdaqddgdxAedBfdafeSgeGhbGhcBhdaxdAxe1");
+        State_from_string(&state, state_string);
+
+        struct MCTSOptions options;
+        MCTSOptions_default(&options);
+        options.iterations = 2000;
+        options.seed = seed;
+        options.save_tree = true;
+        static struct MCTSResults results;
+        mcts(&state, &results, &options);
+
+        if (results.arena.chunk_count < 2) {
+            printf("Search tree doesn't fill more than one chunk\n");
+        }
+        static uint32_t stack[NODE_CHUNK_SIZE * 4];
+        int stack_count = 0;
+        stack[stack_count++] = results.tree;
+        bool split = false;
+        while (stack_count && !split) {
+            const struct Node* node = NodeArena_node(&results.arena, stack[--stack_count]);
+            if (node->children == NO_CHILDREN) {
+                continue;
+            }
+            uint32_t last = node->children + node->children_count - 1;
+            split = node->children >> NODE_CHUNK_BITS != last >> NODE_CHUNK_BITS;
+            for (int i = 0; i < node->children_count; i++) {
+                stack[stack_count++] = node->children + i;
+            }
+        }
+        if (split) {
+            printf("Search tree children are split across chunks\n");
+        }
+        MCTSResults_free_tree(&results);
+    }
+
+    // Thread pool
+    {
+        // Each task runs once a call, and the threads are kept between calls
+        int counts[8] = { 0 };
+        pool_run(8, count_task, counts);
+        pool_run(8, count_task, counts);
+        pool_run(1, count_task, counts);
+        pool_run(0, count_task, counts);
+        for (int i = 0; i < 8; i++) {
+            if (counts[i] != (i == 0 ? 3 : 2)) {
+                printf("Pool doesn't run each task once\n");
+                break;
+            }
+        }
+
+        // Tasks can run jobs of their own at the same time
+        int nested[4 * 3] = { 0 };
+        pool_run(4, nested_task, nested);
+        for (int i = 0; i < 4 * 3; i++) {
+            if (nested[i] != 1) {
+                printf("Pool doesn't run nested jobs' tasks once\n");
+                break;
+            }
+        }
+    }
+
+    // Searches running at once
+    {
+        static struct State states[2];
+        State_from_string(&states[0], "saeAafQbbabebbfGcbbcbSccgcdgcesdaqddgdxAedBfdafeSgeGhbGhcBhdaxdAxe1");
+        State_from_string(&states[1], "QbdBbeGcdAcesdcsebgecqfc1");
+
+        struct MCTSOptions options;
+        MCTSOptions_default(&options);
+        options.iterations = 300;
+        options.seed = seed;
+
+        // Each search's context keeps it apart from the others, so it
+        // plays out the same as it does alone
+        static struct SearchTask alone[2];
+        static struct SearchTask together[2];
+        for (int i = 0; i < 2; i++) {
+            alone[i] = (struct SearchTask) { &states[i], &options };
+            together[i] = alone[i];
+            search_task(alone, i);
+        }
+        pool_run(2, search_task, together);
+
+        for (int i = 0; i < 2; i++) {
+            bool same = alone[i].results.actioni == together[i].results.actioni;
+            for (int a = 0; a < states[i].action_count; a++) {
+                same &= alone[i].results.nodes[a].visits == together[i].results.nodes[a].visits
+                    && alone[i].results.nodes[a].value == together[i].results.nodes[a].value;
+            }
+            if (!same) {
+                printf("Searches running at once don't play out as they do alone\n");
+            }
+        }
+    }
+
+    // Shared tree
+    {
+        strcpy(state_string, "saeAafQbbabebbfGcbbcbSccgcdgcesdaqddgdxAedBfdafeSgeGhbGhcBhdaxdAxe1");
+        State_from_string(&state, state_string);
+
+        struct MCTSOptions options;
+        MCTSOptions_default(&options);
+        options.iterations = 500;
+        options.threads = 4;
+        options.seed = seed;
+        options.save_tree = true;
+        static struct MCTSResults results;
+        mcts(&state, &results, &options);
+
+        // Every thread's iterations go into the one tree
+        const struct Node* root = NodeArena_node(&results.arena, results.tree);
+        if (results.stats.iterations != 4 * options.iterations || root->visits != results.stats.iterations) {
+            printf("Shared tree doesn't count every thread's iterations\n");
+        }
+
+        // Virtual losses are all taken back, and each node's visits add up
+        // to no more than its parent's
+        static uint32_t stack[NODE_CHUNK_SIZE];
+        int stack_count = 0;
+        stack[stack_count++] = results.tree;
+        bool virtual = false;
+        bool overcounted = false;
+        while (stack_count) {
+            const struct Node* node = NodeArena_node(&results.arena, stack[--stack_count]);
+            virtual |= node->virtual_visits != 0 || (!isinf(node->value) && fabsf(node->value) > node->visits);
+            if (node->children == NO_CHILDREN) {
+                continue;
+            }
+
+            unsigned int visits = 0;
+            for (int i = 0; i < node->children_count; i++) {
+                visits += NodeArena_node(&results.arena, node->children + i)->visits;
+                stack[stack_count++] = node->children + i;
+            }
+            overcounted |= visits > node->visits;
+        }
+        if (virtual) {
+            printf("Shared tree has virtual losses left in it\n");
+        }
+        if (overcounted) {
+            printf("Shared tree children have more visits than their parent\n");
+        }
+        MCTSResults_free_tree(&results);
+    }
+
+    // Node table
+    {
+        struct NodeTable table;
+        NodeTable_init(&table, MIN_NODE_TABLE_BITS);
+
+        // The first node added for a position is the one found after
+        uint64_t hash = 0x123456789ABCDEF0;
+        if (NodeTable_find_or_add(&table, hash, 5) != 5 || NodeTable_find_or_add(&table, hash, 7) != 5) {
+            printf("Node table doesn't find the first node added\n");
+        }
+
+        // Positions in the same bucket are probed past each other
+        uint64_t collision = hash ^ (UINT64_C(1) << 40);
+        if (NodeTable_find_or_add(&table, collision, 9) != 9
+            || NodeTable_find_or_add(&table, collision, 11) != 9
+            || NodeTable_find_or_add(&table, hash, 13) != 5) {
+            printf("Node table mixes up positions in the same bucket\n");
+        }
+        if (!table.entries[(hash + 1) & table.mask]) {
+            printf("Node table doesn't probe the next bucket\n");
+        }
+
+        // Once the probes are full, nodes are given back without being added
+        for (int i = 2; i < NODE_TABLE_PROBES; i++) {
+            NodeTable_find_or_add(&table, hash ^ ((uint64_t)i << 40), 100 + i);
+        }
+        uint64_t full = hash ^ ((uint64_t)NODE_TABLE_PROBES << 40);
+        if (NodeTable_find_or_add(&table, full, 15) != 15 || NodeTable_find_or_add(&table, full, 17) != 17) {
+            printf("Node table adds past its probes\n");
+        }
+        if (NodeTable_find_or_add(&table, hash ^ ((uint64_t)(NODE_TABLE_PROBES - 1) << 40), 19) != 100 + NODE_TABLE_PROBES - 1) {
+            printf("Node table doesn't find its last probe\n");
+        }
+
+        NodeTable_free(&table);
+    }
+
+    // Following graph links
+    {
+        strcpy(state_string, "saeAafQbbabebbfGcbbcbSccgcdgcesdaqddgdxAedBfdafeSgeGhbGhcBhdaxdAxe1");
+        State_from_string(&state, state_string);
+
+        struct MCTSOptions options;
+        MCTSOptions_default(&options);
+        options.graph = true;
+        static struct MCTSContext context;
+        struct NodeArena arena;
+        NodeArena_init(&arena);
+        context.options = &options;
+        context.arena = &arena;
+        context.stats = (struct MCTSStats) { 0 };
+
+        uint32_t linki = NodeArena_alloc(&arena, 2);
+        uint32_t nodei = linki + 1;
+        struct Node* link = NodeArena_node(&arena, linki);
+        struct Node* node = NodeArena_node(&arena, nodei);
+        *link = (struct Node) { .children = nodei, .children_count = LINK };
+        *node = (struct Node) { .visits = 4, .value = 2, .children = NO_CHILDREN };
+
+        // A link behind its node backs up the node's mean
+        context.path_length = 0;
+        if (Node_follow(&context, link, nodei, &state) != .5f || link->visits != 1 || link->value != .5f) {
+            printf("Graph link doesn't catch up with its node\n");
+        }
+
+        // Coming back around to a position on the path scores a draw
+        context.path[0] = State_hash(&state);
+        context.path_length = 1;
+        if (Node_follow(&context, link, nodei, &state) != 0 || link->visits != 2 || link->value != .5f
+            || node->visits != 4) {
+            printf("Graph repeat isn't scored as a draw\n");
+        }
+
+        NodeArena_free(&arena);
+    }
+
+    // Tree reuse
+    for (int lazy = 0; lazy < 2; lazy++) {
+        strcpy(state_string, "saeAafQbbabebbfGcbbcbSccgcdgcesdaqddgdxAedBfdafeSgeGhbGhcBhdaxdAxe1");
+        State_from_string(&state, state_string);
+
+        struct MCTSOptions options;
+        MCTSOptions_default(&options);
+        options.iterations = 1000;
+        options.seed = seed;
+        options.save_tree = true;
+        options.reuse_tree = true;
+        options.puct = lazy;
+        static struct MCTSResults results;
+        results.tree = NO_NODE;
+        mcts(&state, &results, &options);
+
+        // The subtree under the most visited move, with the children of a
+        // lazily expanded node laid out by action, as they will be
+        int k = results.actioni;
+        struct State after;
+        State_copy(&state, &after);
+        State_act(&after, &state.actions[k]);
+
+        const struct Node* root = NodeArena_node(&results.arena, results.tree);
+        struct Node child = *NodeArena_node(&results.arena, root->children + k);
+        static struct Node grandchildren[MAX_ACTIONS];
+        for (int i = 0; i < after.action_count; i++) {
+            grandchildren[i] = (struct Node) { .action = i };
+        }
+        uint32_t next = child.children;
+        for (int i = 0, block_size = LAZY_BLOCK_SIZE, left = child.children_count & ~LAZY; left; i++, left--) {
+            const struct Node* grandchild = NodeArena_node(&results.arena, next++);
+            grandchildren[lazy ? grandchild->action : i] = *grandchild;
+            if (lazy && i + 1 == block_size) {
+                next = NodeArena_node(&results.arena, next)->children;
+                block_size *= 2;
+                i = -1;
+            }
+        }
+
+        MCTSResults_descend(&results, &state, k);
+        root = NodeArena_node(&results.arena, results.tree);
+        if (results.tree_hash != State_hash(&after) || root->visits != child.visits || root->value != child.value) {
+            printf("Tree reuse doesn't keep the child moved to\n");
+        }
+        if (root->children_count != after.action_count) {
+            printf("Tree reuse doesn't keep a child for each action\n");
+        }
+        for (int i = 0; i < after.action_count && root->children_count == after.action_count; i++) {
+            const struct Node* grandchild = NodeArena_node(&results.arena, root->children + i);
+            if (grandchild->action != i || grandchild->visits != grandchildren[i].visits
+                || grandchild->value != grandchildren[i].value) {
+                printf("Tree reuse doesn't keep the child's children\n");
+                break;
+            }
+        }
 
-        if (path_size != 0) {
-            printf("Incorrect length for beetle seek path\n");
+        // Picking up the tree counts its visits, and gives the root's
+        // children their priors, whether they were opened or not
+        mcts(&after, &results, &options);
+        if (results.stats.reused_visits != child.visits) {
+            printf("Tree reuse doesn't pick up the saved tree\n");
+        }
+        float priors[MAX_ACTIONS];
+        options.prior(&after, &options, priors);
+        for (int i = 0; i < after.action_count && lazy; i++) {
+            if (results.nodes[i].prior != priors[i]) {
+                printf("Tree reuse doesn't give the root's children priors\n");
+                break;
+            }
+        }
+
+        // A tree for another position is freed
+        mcts(&state, &results, &options);
+        if (results.stats.reused_visits) {
+            printf("Tree reuse picks up a tree for another position\n");
+        }
+        MCTSResults_descend(&results, &after, 0);
+        if (results.tree != NO_NODE) {
+            printf("Tree reuse descends a tree for another position\n");
+        }
+    }
+
+    // Solver
+    {
+        const char* proven[] = {
+            // Every move leaves the enemy a move surrounding the queen
+            "AbdacdbceschadcsddbdfQdggdhgedGeeaefBfcGfdgfeBgbqgcGgdShcShd2",
+            // A move leaves the enemy no way of stopping a win after it
+            "sbgbcfacgqcigdgAdisegaehafeSffggcggdQgebgeAhdBidBidGjdAjeGkcGkdSlb2",
+        };
+        for (int win = 0; win < 2; win++) {
+            strcpy(state_string, proven[win]);
+            State_from_string(&state, state_string);
+
+            struct MCTSOptions options;
+            MCTSOptions_default(&options);
+            options.iterations = 20000;
+            options.seed = seed;
+            static struct MCTSResults results;
+
+            // think reports to stderr
+            FILE* report = tmpfile();
+            fflush(stderr);
+            int saved = dup(STDERR_FILENO);
+            dup2(fileno(report), STDERR_FILENO);
+            think(&state, &results, &options);
+            fflush(stderr);
+            dup2(saved, STDERR_FILENO);
+            close(saved);
+
+            bool reported = false;
+            char line[256];
+            rewind(report);
+            while (fgets(line, sizeof(line), report)) {
+                reported |= strstr(line, win ? "proven win" : "proven loss") != NULL;
+            }
+            fclose(report);
+
+            // A move is a proven win when its child is a proven loss for
+            // the enemy, and the root is a proven loss when every child is
+            // a proven win for them
+            bool proven_children = true;
+            for (int i = 0; i < state.action_count; i++) {
+                proven_children &= results.nodes[i].value == INFINITY;
+            }
+            if (win) {
+                proven_children = results.nodes[results.actioni].value == -INFINITY;
+            }
+
+            if (!proven_children || results.score != (win ? INFINITY : -INFINITY)) {
+                printf("Solver doesn't prove a %s\n", win ? "win" : "loss");
+            }
+            if (results.stats.iterations >= options.iterations) {
+                printf("Solver doesn't stop once the root is proven\n");
+            }
+            if (!reported) {
+                printf("think doesn't report a proven %s\n", win ? "win" : "loss");
+            }
+        }
+    }
+
+    // Opening lazily expanded children
+    {
+        strcpy(state_string, "saeAafQbbabebbfGcbbcbSccgcdgcesdaqddgdxAedBfdafeSgeGhbGhcBhdaxdAxe1");
+        State_from_string(&state, state_string);
+
+        struct MCTSOptions options;
+        MCTSOptions_default(&options);
+        options.prior = rising_priors;
+        static struct MCTSContext context;
+        struct NodeArena arena;
+        NodeArena_init(&arena);
+        context.options = &options;
+        context.arena = &arena;
+        context.stats = (struct MCTSStats) { 0 };
+
+        uint32_t nodei = NodeArena_alloc(&arena, 1);
+        struct Node* node = NodeArena_node(&arena, nodei);
+        *node = (struct Node) { .children = NO_CHILDREN };
+
+        // Blocks of 4, 8 and 16 children, in order of prior, each followed
+        // by a node linking to the next
+        uint32_t opened[4 + 8 + 16];
+        bool blocks = true;
+        for (int i = 0; i < 4 + 8 + 16; i++) {
+            opened[i] = Node_open(&context, node, i, &state);
+            const struct Node* child = NodeArena_node(&arena, opened[i]);
+            blocks &= node->children_count == (LAZY | (i + 1))
+                && child->action == state.action_count - 1 - i
+                && child->prior == (float)(state.action_count - i) / state.action_count;
+        }
+        blocks &= node->children == opened[0];
+        for (int i = 1; i < 4 + 8 + 16; i++) {
+            if (i == 4 || i == 4 + 8) {
+                blocks &= NodeArena_node(&arena, opened[i - 1] + 1)->children == opened[i];
+            } else {
+                blocks &= opened[i] == opened[i - 1] + 1;
+            }
+        }
+        if (!blocks || context.stats.nodes != 4 + 8 + 16) {
+            printf("Lazily expanded children aren't opened in blocks of 4, 8 and 16\n");
+        }
+
+        // Opening a child that's already counted gets the same child
+        if (Node_open(&context, node, 5, &state) != opened[5] || node->children_count != (LAZY | (4 + 8 + 16))) {
+            printf("Opening a child again gets another child\n");
+        }
+
+        NodeArena_free(&arena);
+    }
+
+    // PUCT opens children in order of prior
+    {
+        strcpy(state_string, "saeAafQbbabebbfGcbbcbSccgcdgcesdaqddgdxAedBfdafeSgeGhbGhcBhdaxdAxe1");
+        State_from_string(&state, state_string);
+
+        struct MCTSOptions options;
+        MCTSOptions_default(&options);
+        options.puct = true;
+        options.prior = rising_priors;
+        static struct MCTSContext context;
+        struct NodeArena arena;
+        NodeArena_init(&arena);
+        context.options = &options;
+        context.arena = &arena;
+        context.stats = (struct MCTSStats) { 0 };
+
+        uint32_t nodei = NodeArena_alloc(&arena, 1);
+        struct Node* node = NodeArena_node(&arena, nodei);
+        *node = (struct Node) { .visits = 1, .children = NO_CHILDREN };
+
+        // An unvisited child is picked again, rather than opening another
+        // with a lower prior; once it's been visited and lost, the next is
+        // opened
+        bool ordered = true;
+        for (int i = 0; i < 10; i++) {
+            uint32_t childi = Node_select_puct(&context, node, &state);
+            struct Node* child = NodeArena_node(&arena, childi);
+            ordered &= child->action == state.action_count - 1 - i
+                && Node_select_puct(&context, node, &state) == childi
+                && node->children_count == (LAZY | (i + 1));
+            child->visits = 1;
+            child->value = 1;
+        }
+        if (!ordered) {
+            printf("PUCT doesn't open children in order of prior\n");
+        }
+
+        NodeArena_free(&arena);
+    }
+
+    // Progressive widening opens children as visits grow
+    {
+        strcpy(state_string, "saeAafQbbabebbfGcbbcbSccgcdgcesdaqddgdxAedBfdafeSgeGhbGhcBhdaxdAxe1");
+        State_from_string(&state, state_string);
+
+        struct MCTSOptions options;
+        MCTSOptions_default(&options);
+        options.widening = true;
+        options.prior = rising_priors;
+        static struct MCTSContext context;
+        struct NodeArena arena;
+        NodeArena_init(&arena);
+        context.options = &options;
+        context.arena = &arena;
+        context.stats = (struct MCTSStats) { 0 };
+
+        uint32_t nodei = NodeArena_alloc(&arena, 1);
+        struct Node* node = NodeArena_node(&arena, nodei);
+        *node = (struct Node) { .children = NO_CHILDREN };
+
+        // With the default constant and exponent, 2 * sqrt(visits) children
+        // are open, which is 2 at 1 visit, 4 at 4, 6 at 9 and 8 at 16; a
+        // selection opens at most one
+        bool widened = true;
+        bool ordered = true;
+        int opened = 0;
+        for (unsigned int visits = 1; visits <= 16; visits++) {
+            for (int i = 0; i < 2; i++) {
+                uint32_t childi = Node_select_widening(&context, node, &state, visits);
+                struct Node* child = NodeArena_node(&arena, childi);
+                if ((node->children_count & ~LAZY) > opened) {
+                    ordered &= child->action == state.action_count - 1 - opened;
+                    opened++;
+                }
+                child->visits++;
+            }
+
+            int expected = ceilf(2 * sqrtf(visits));
+            widened &= opened == expected;
+        }
+        if (!widened) {
+            printf("Progressive widening doesn't open children as visits grow\n");
+        }
+        if (!ordered) {
+            printf("Progressive widening doesn't open children in order of prior\n");
+        }
+
+        NodeArena_free(&arena);
+    }
+
+#ifdef __SSE2__
+    // UCT selection with SSE picks the same child as without
+    {
+        struct MCTSOptions options;
+        MCTSOptions_default(&options);
+        static struct MCTSContext context;
+        context.options = &options;
+        // Shared trees are selected from without SSE
+        context.shared = true;
+        context.table = NULL;
+
+        static struct Node children[64];
+        for (int trial = 0; trial < 10000; trial++) {
+            int count = 1 + rand() % 64;
+            // Unvisited children are rare enough that most trials compare
+            // scores
+            bool unvisited = rand() % 4 == 0;
+            unsigned int visits = 1;
+            for (int i = 0; i < count; i++) {
+                children[i].visits = unvisited && rand() % 8 == 0 ? 0 : 1 + rand() % 1000;
+                children[i].value = ((float)rand() / RAND_MAX * 2 - 1) * children[i].visits;
+                if (rand() % 20 == 0) {
+                    children[i].value = rand() % 2 ? INFINITY : -INFINITY;
+                }
+                visits += children[i].visits;
+            }
+
+            int scalar = Node_select_uct(&context, children, count, visits);
+            int sse = Node_select_uct_sse(children, count, options.uctc, logf(visits));
+            if (scalar != sse) {
+                printf("UCT selection with SSE picks child %d rather than %d\n", sse, scalar);
+                break;
+            }
+        }
+
+        // Ties between proven children
+        for (int proven = 0; proven < 2; proven++) {
+            for (int count = 1; count <= 9; count++) {
+                for (int i = 0; i < count; i++) {
+                    children[i].visits = 10;
+                    children[i].value = proven ? INFINITY : -INFINITY;
+                }
+                if (Node_select_uct(&context, children, count, 10 * count)
+                    != Node_select_uct_sse(children, count, options.uctc, logf(10 * count))) {
+                    printf("UCT selection with SSE breaks ties differently\n");
+                }
+            }
+        }
+    }
+#endif
+
+    // Random numbers
+    {
+        struct Rng rng;
+        Rng_seed(&rng, seed);
+
+        const uint32_t bounds[] = { 1, 2, 3, 7, 100, MAX_ACTIONS, UINT32_MAX };
+        for (int b = 0; b < sizeof(bounds) / sizeof(bounds[0]); b++) {
+            for (int i = 0; i < 10000; i++) {
+                if (Rng_below(&rng, bounds[b]) >= bounds[b]) {
+                    printf("Rng_below returns a number out of bounds\n");
+                    break;
+                }
+            }
+        }
+
+        // Each number below 6 comes up a sixth of the time, within 5
+        // standard deviations
+        int counts[6] = { 0 };
+        for (int i = 0; i < 60000; i++) {
+            counts[Rng_below(&rng, 6)]++;
+        }
+        for (int i = 0; i < 6; i++) {
+            if (abs(counts[i] - 10000) > 5 * 91) {
+                printf("Rng_below is biased below 6: %d\n", counts[i]);
+            }
+        }
+
+        // Taking 32 random bits modulo 3 * 2^30 would come up below 2^30
+        // half the time, rather than a third
+        int low = 0;
+        for (int i = 0; i < 300000; i++) {
+            low += Rng_below(&rng, UINT32_C(3) << 30) < UINT32_C(1) << 30;
+        }
+        if (abs(low - 100000) > 5 * 258) {
+            printf("Rng_below has modulo bias: %d of 300000 in the first third\n", low);
+        }
+
+        double sum = 0;
+        bool in_range = 0xFFFFFF * 0x1.0p-24f < 1;
+        for (int i = 0; i < 100000; i++) {
+            float unit = Rng_unit(&rng);
+            in_range &= unit >= 0 && unit < 1;
+            sum += unit;
+        }
+        if (!in_range) {
+            printf("Rng_unit returns a number outside [0, 1)\n");
+        }
+        if (fabs(sum / 100000 - .5) > .005) {
+            printf("Rng_unit has a mean of %f\n", sum / 100000);
+        }
+
+        // The same seed gives the same numbers, and any seed, even 0, a
+        // state that isn't all zero
+        struct Rng same[2];
+        Rng_seed(&same[0], seed);
+        Rng_seed(&same[1], seed);
+        bool repeated = true;
+        for (int i = 0; i < 100; i++) {
+            repeated &= Rng_next(&same[0]) == Rng_next(&same[1]);
+        }
+        if (!repeated) {
+            printf("Rng doesn't repeat for the same seed\n");
+        }
+        Rng_seed(&rng, 0);
+        if (!(rng.s[0] | rng.s[1] | rng.s[2] | rng.s[3])) {
+            printf("Rng seeded with 0 has an all-zero state\n");
+        }
+    }
+    {
+        // A single-threaded search with the same seed plays out the same
+        strcpy(state_string, "saeAafQbbabebbfGcbbcbSccgcdgcesdaqddgdxAedBfdafeSgeGhbGhcBhdaxdAxe1");
+        State_from_string(&state, state_string);
+
+        struct MCTSOptions options;
+        MCTSOptions_default(&options);
+        options.iterations = 300;
+        options.seed = seed;
+        options.light_playouts = true;
+        static struct MCTSResults results[2];
+        for (int i = 0; i < 2; i++) {
+            mcts(&state, &results[i], &options);
+        }
+
+        bool same = results[0].stats.simulations == results[1].stats.simulations
+            && results[0].stats.mean_sim_depth == results[1].stats.mean_sim_depth;
+        for (int a = 0; a < state.action_count; a++) {
+            same &= results[0].nodes[a].visits == results[1].nodes[a].visits
+                && results[0].nodes[a].value == results[1].nodes[a].value;
+        }
+        if (!same) {
+            printf("Searches with the same seed play out differently\n");
         }
     }
 
@@ -1,13 +1,12 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
-#include <sys/wait.h>
 #include <time.h>
-#include <unistd.h>
 
 #include "book.h"
 #include "mcts.h"
+#include "rng.h"
+#include "simulate.h"
 #include "state.h"
 #include "stateio.h"
 #include "think.h"
@@ -17,21 +16,20 @@
 void think(
     const struct State* state,
     struct MCTSResults* results,
-    const struct MCTSOptions* options,
-    int workers)
+    const struct MCTSOptions* options)
 {
     char state_string[STATE_STRING_SIZE];
     char action_string[ACTION_STRING_SIZE];
 
-    if (state->winning_action) {
+    if (state->winning_action != NO_ACTION) {
         fprintf(stderr, "Taking win\n");
         fprintf(stderr, "result: win\n");
 
-        results->presearch_action = state->winning_action;
+        results->presearch_action = &state->actions[state->winning_action];
 
         struct State after;
         State_copy(state, &after);
-        State_act(&after, state->winning_action);
+        State_act(&after, &state->actions[state->winning_action]);
         State_normalize(&after);
         State_to_string(&after, state_string);
         fprintf(stderr, "next:\t%s\n", state_string);
@@ -52,7 +50,12 @@ void think(
         return;
     }
 
-    const struct Action* book_action = opening_move(state);
+    // The book has a stream of its own, rather than the one the first
+    // search thread is seeded with
+    struct Rng rng;
+    uint64_t book_seed = options->seed;
+    Rng_seed(&rng, splitmix64(&book_seed));
+    const struct Action* book_action = opening_move(state, &rng);
     if (book_action) {
         fprintf(stderr, "Book action\n");
 
@@ -67,63 +70,28 @@ void think(
         return;
     }
 
-    fprintf(stderr, "MCTS options:\titerations=%ld seconds=%ld workers=%d uctc=%.2f\n",
+    fprintf(stderr, "MCTS options:\titerations=%ld seconds=%ld seed=%lu threads=%d root_parallel=%d graph=%d puct=%d widening=%d uctc=%.2f puctc=%.2f\n",
         options->iterations,
         options->seconds,
-        workers,
-        options->uctc);
-    fprintf(stderr, "sim options:\tmax_depth=%d queen_adjacent_action_bias=%.2f queen_nearby_action_bias=%.2f queen_sidestep_bias=%.2f beetle_move_bias=%.2f cut_point_diff_terminate=%d\n",
+        options->seed,
+        options->threads,
+        options->root_parallel,
+        options->graph,
+        options->puct,
+        options->widening,
+        options->uctc,
+        options->puctc);
+    fprintf(stderr, "sim options:\tmax_depth=%d eval_depth=%d light=%d queen_adjacent_action_bias=%.2f queen_nearby_action_bias=%.2f queen_sidestep_bias=%.2f beetle_move_bias=%.2f cut_point_diff_terminate=%d\n",
         options->max_sim_depth,
+        options->eval_depth,
+        options->light_playouts,
         options->queen_adjacent_action_bias,
         options->queen_nearby_action_bias,
         options->queen_sidestep_bias,
         options->beetle_move_bias,
         options->cut_point_diff_terminate);
 
-    int pipefd[2];
-    pipe(pipefd);
-
-    for (int i = 0; i < workers; i++) {
-        srand(rand());
-        if (fork() > 0) {
-            continue;
-        }
-        struct MCTSResults results;
-        mcts(state, &results, options);
-        write(pipefd[1], &results, sizeof(struct MCTSResults));
-        exit(0);
-    }
-
-    memset(results, 0, sizeof(struct MCTSResults));
-
-    // TODO
-    struct timeval start;
-    gettimeofday(&start, NULL);
-
-    for (int i = 0; i < workers; i++) {
-        wait(NULL);
-
-        struct MCTSResults worker_results;
-        read(pipefd[0], &worker_results, sizeof(struct MCTSResults));
-
-        for (int j = 0; j < state->action_count; j++) {
-            results->nodes[j].visits += worker_results.nodes[j].visits;
-            results->nodes[j].value += worker_results.nodes[j].value;
-        }
-
-        results->stats.iterations += worker_results.stats.iterations;
-        results->stats.nodes += worker_results.stats.nodes;
-        results->stats.tree_bytes += worker_results.stats.tree_bytes;
-        results->stats.simulations += worker_results.stats.simulations;
-        results->stats.mean_sim_depth += worker_results.stats.mean_sim_depth / workers;
-        results->stats.depth_outs += worker_results.stats.depth_outs;
-        results->stats.cut_point_terminations += worker_results.stats.cut_point_terminations;
-        results->stats.change_iterations = results->stats.change_iterations > worker_results.stats.change_iterations ? results->stats.change_iterations : worker_results.stats.change_iterations;
-    }
-
-    struct timeval end;
-    gettimeofday(&end, NULL);
-    results->stats.duration = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+    mcts(state, results, options);
 
     results->score = -INFINITY;
     int top_actionis[TOP_ACTIONS];
@@ -158,6 +126,9 @@ void think(
     State_act(&after, &state->actions[results->actioni]);
 
     fprintf(stderr, "score:\t\t%.2f\n", results->score);
+    if (isinf(results->score)) {
+        fprintf(stderr, "result:\t\tproven %s\n", results->score > 0 ? "win" : "loss");
+    }
 
     fprintf(stderr, "iterations:\t%ld\n", results->stats.iterations);
     fprintf(stderr, "change iters:\t%d\n", results->stats.change_iterations);
@@ -180,8 +151,31 @@ void think(
     fprintf(stderr,
         "depth outs:\t%.2f%%\n",
         100 * (float)results->stats.depth_outs / results->stats.simulations);
+    if (options->eval_depth) {
+        fprintf(stderr,
+            "eval outs:\t%.2f%%\n",
+            100 * (float)results->stats.eval_outs / results->stats.simulations);
+    }
+    uint64_t plies = 0;
+    for (int i = 0; i < NUM_POLICY_CATEGORIES; i++) {
+        plies += results->stats.policy_picks[i];
+    }
+    fprintf(stderr, "policy picks:\t");
+    for (int i = 0, first = 1; i < NUM_POLICY_CATEGORIES; i++) {
+        if (results->stats.policy_picks[i]) {
+            fprintf(stderr, "%s%s %.2f%%", first ? "" : ", ", POLICY_CATEGORY_NAMES[i],
+                100 * (float)results->stats.policy_picks[i] / plies);
+            first = 0;
+        }
+    }
+    fprintf(stderr, "\n");
+    if (results->stats.light_plies) {
+        fprintf(stderr, "light plies:\t%.2f%%\n", 100 * (float)results->stats.light_plies / plies);
+    }
     fprintf(
         stderr, "tree size:\t%ld MiB\n", results->stats.tree_bytes / 1024 / 1024);
+    fprintf(stderr, "transpositions:\t%d\n", results->stats.transpositions);
+    fprintf(stderr, "reused visits:\t%d\n", results->stats.reused_visits);
 
     for (int i = 0; i < TOP_ACTIONS && i < state->action_count; i++) {
         Action_to_string(&state->actions[top_actionis[i]], action_string);
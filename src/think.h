@@ -4,5 +4,4 @@
 void think(
     const struct State* state,
     struct MCTSResults* results,
-    const struct MCTSOptions* options,
-    int workers);
+    const struct MCTSOptions* options);
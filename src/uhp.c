@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "mcts.h"
 #include "state.h"
@@ -28,6 +29,9 @@ struct HistoryMove {
 };
 
 struct State state;
+// Kept between searches, so that the tree below the moves played since
+// can be picked up again
+struct MCTSResults results = { .tree = NO_NODE };
 struct HistoryMove* history = NULL;
 int move_number;
 int allocated_size;
@@ -35,6 +39,7 @@ int allocated_size;
 void reset_game_data()
 {
     State_new(&state);
+    MCTSResults_free_tree(&results);
     free(history);
     history = malloc(sizeof(struct HistoryMove) * HISTORY_CHUNK_SIZE);
     allocated_size = HISTORY_CHUNK_SIZE;
@@ -62,9 +67,9 @@ int coords_to_piecestring(const struct Coords* coords, char piecestring[])
             }
         }
     } else {
-        struct Piece* piece = state.grid[coords->q][coords->r];
+        struct Piece* piece = State_piece(&state, state.grid[coords->q][coords->r]);
         while (piece->on_top) {
-            piece = piece->on_top;
+            piece = State_piece(&state, piece->on_top);
         }
 
         player_char = UHP_PLAYER_CHAR[piece->player];
@@ -226,6 +231,7 @@ bool act_movestring(const char movestring[])
         return false;
     }
 
+    MCTSResults_descend(&results, &state, actioni);
     State_act(&state, &state.actions[actioni]);
     return true;
 }
@@ -351,6 +357,8 @@ void bestmove(const char args[])
 
     struct MCTSOptions options;
     MCTSOptions_default(&options);
+    // Engine searches aren't reproducible, as zoe's aren't without --seed
+    options.seed = time(NULL);
 
     if (strcmp(limit_type, "depth") == 0) {
         options.iterations = atol(limit_value);
@@ -376,10 +384,11 @@ void bestmove(const char args[])
         return;
     }
 
-    struct MCTSResults results;
-    // TODO we're not seeding the PRNG at the moment
-    // TODO specify number of workers with options
-    think(&state, &results, &options, 1);
+    options.save_tree = true;
+    options.reuse_tree = true;
+
+    // TODO specify number of threads with options
+    think(&state, &results, &options);
 
     const struct Action* selected_action;
     if (results.presearch_action) {
@@ -411,6 +420,7 @@ void undo(const char args[])
 
     move_number -= to_undo;
     State_new(&state);
+    MCTSResults_free_tree(&results);
     for (int i = 0; i < move_number; i++) {
         act_movestring(history[i].movestring);
     }
@@ -1,3 +1,4 @@
+#include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -7,6 +8,7 @@
 #include "examine.h"
 #include "mcts.h"
 #include "minimax.h"
+#include "rng.h"
 #include "state.h"
 #include "stateio.h"
 #include "think.h"
@@ -26,23 +28,27 @@ int main(int argc, char* argv[])
 {
     fprintf(stderr, "Zo\u00e9 v1.1a (built %s %s)\n", __DATE__, __TIME__);
 
-    time_t seed = time(NULL);
-    srand(seed);
-
     init_coords();
+    init_state();
 
     enum Command command = NONE;
-    int workers = 1;
 
     struct MCTSOptions options;
     MCTSOptions_default(&options);
+    // Searches are only reproducible with --seed
+    options.seed = time(NULL);
 
     struct MinimaxOptions minimax_options;
     MinimaxOptions_default(&minimax_options);
 
+    static const struct option long_options[] = {
+        { "seed", required_argument, NULL, 'S' },
+        { NULL, 0, NULL, 0 }
+    };
+
     int opt;
     struct Action action;
-    while ((opt = getopt(argc, argv, "vnltsrxa:i:c:w:j:k:z:b:d:p:u:o:e:")) != -1) {
+    while ((opt = getopt_long(argc, argv, "vnltsrxRgPWLE:a:i:c:w:j:k:z:b:d:p:u:o:e:", long_options, NULL)) != -1) {
         switch (opt) {
         case 'v':
             return 0;
@@ -72,6 +78,30 @@ int main(int argc, char* argv[])
             command = EXAMINE;
             break;
 
+        case 'R':
+            options.root_parallel = true;
+            break;
+
+        case 'g':
+            options.graph = true;
+            break;
+
+        case 'P':
+            options.puct = true;
+            break;
+
+        case 'W':
+            options.widening = true;
+            break;
+
+        case 'L':
+            options.light_playouts = true;
+            break;
+
+        case 'E':
+            options.eval_depth = atoi(optarg);
+            break;
+
         case 'a':
             command = ACT;
             Action_from_string(&action, optarg);
@@ -123,7 +153,11 @@ int main(int argc, char* argv[])
             break;
 
         case 'w':
-            workers = atoi(optarg);
+            options.threads = atoi(optarg);
+            break;
+
+        case 'S':
+            options.seed = strtoull(optarg, NULL, 10);
             break;
         }
     }
@@ -179,7 +213,9 @@ int main(int argc, char* argv[])
     }
 
     case RANDOM: {
-        struct Action* action = &state.actions[rand() % state.action_count];
+        struct Rng rng;
+        Rng_seed(&rng, options.seed);
+        struct Action* action = &state.actions[Rng_below(&rng, state.action_count)];
 
         Action_to_string(action, action_string);
         printf("%s\n", action_string);
@@ -202,7 +238,7 @@ int main(int argc, char* argv[])
     }
 
     struct MCTSResults results;
-    think(&state, &results, &options, workers);
+    think(&state, &results, &options);
 
     const struct Action* selected_action;
     if (results.presearch_action) {
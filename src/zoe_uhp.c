@@ -1,13 +1,11 @@
 #include "coords.h"
+#include "state.h"
 #include "uhp.h"
 
 int main()
 {
-    // TODO don't use seed while we're hammering out UHP bugs
-    // time_t seed = time(NULL);
-    // srand(seed);
-
     init_coords();
+    init_state();
 
     uhp_loop();
 